@@ -0,0 +1,246 @@
+#include "TutorialClass/EntryRangeSplitter.h"
+
+#include "TutorialClass/InputSchemaCache.h"
+
+#include "FastFrames/Logger.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+EntryRangeSplitter::EntryRangeSplitter(const std::string& treeName, const InputSchemaCache* cache) :
+  m_treeName(treeName),
+  m_cache(cache),
+  m_begin(0),
+  m_end(-1),
+  m_nOpenedFiles(0)
+{
+}
+
+bool EntryRangeSplitter::readFileEntries(const std::string& path) {
+
+  std::ifstream in(path);
+  if (!in.good()) return false;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream stream(line);
+    std::string treeName;
+    FileInfo info;
+    if (!(stream >> treeName >> info.path >> info.entries >> info.zipBytes)) {
+      LOG(ERROR) << "Wrong line: " << line << " in the file entries table: " << path << "\n";
+      throw std::invalid_argument("");
+    }
+    if (treeName != m_treeName) continue;
+    Long64_t cluster(0);
+    while (stream >> cluster) {
+      info.clusters.emplace_back(cluster);
+    }
+    m_fileEntries[info.path] = std::move(info);
+  }
+
+  return true;
+}
+
+void EntryRangeSplitter::addFile(const std::string& path) {
+
+  auto itr = m_fileEntries.find(path);
+  if (itr != m_fileEntries.end()) {
+    m_files.emplace_back(itr->second);
+    return;
+  }
+
+  // cached values: entries, compressed bytes, cluster starts
+  const std::string entry = "clusters_" + m_treeName;
+  std::vector<std::string> values;
+  if (m_cache && m_cache->read(path, entry, values) && values.size() >= 2) {
+    FileInfo info;
+    info.path = path;
+    info.entries = std::stoll(values.at(0));
+    info.zipBytes = std::stoll(values.at(1));
+    for (std::size_t i = 2; i < values.size(); ++i) {
+      info.clusters.emplace_back(std::stoll(values.at(i)));
+    }
+    m_files.emplace_back(std::move(info));
+    return;
+  }
+
+  FileInfo info = this->readFile(path);
+  ++m_nOpenedFiles;
+  if (m_cache) {
+    values = {std::to_string(info.entries), std::to_string(info.zipBytes)};
+    for (const Long64_t icluster : info.clusters) {
+      values.emplace_back(std::to_string(icluster));
+    }
+    m_cache->write(path, entry, values);
+  }
+  m_files.emplace_back(std::move(info));
+}
+
+void EntryRangeSplitter::selectEntries(const Long64_t begin, const Long64_t end) {
+  if (begin < 0 || (end >= 0 && end < begin)) {
+    LOG(ERROR) << "Wrong range of entries: [" << begin << ", " << end << ")\n";
+    throw std::invalid_argument("");
+  }
+  m_begin = begin;
+  m_end = end;
+}
+
+std::vector<EntryRange> EntryRangeSplitter::jobRanges(const std::size_t nJobs, const std::size_t jobIndex) const {
+
+  std::vector<EntryRange> result;
+  if (jobIndex >= nJobs) {
+    LOG(ERROR) << "Job index: " << jobIndex << " is not smaller than the number of jobs: " << nJobs << "\n";
+    throw std::invalid_argument("");
+  }
+
+  const Long64_t begin = this->boundary(nJobs, jobIndex);
+  const Long64_t end = this->boundary(nJobs, jobIndex + 1);
+
+  Long64_t offset(0);
+  for (std::size_t ifile = 0; ifile < m_files.size(); ++ifile) {
+    const FileInfo& info = m_files.at(ifile);
+    const Long64_t fileBegin = std::max(begin, offset);
+    const Long64_t fileEnd = std::min(end, offset + info.entries);
+    if (fileBegin < fileEnd) {
+      result.push_back({ifile, info.path, fileBegin - offset, fileEnd - offset});
+    }
+    offset += info.entries;
+  }
+
+  return result;
+}
+
+std::string EntryRangeSplitter::fileEntriesPath(const std::string& directory) {
+  return (std::filesystem::path(directory) / "file_entries.txt").string();
+}
+
+void EntryRangeSplitter::writeFileEntries(const std::string& path, const std::string& treeName, const std::vector<FileInfo>& files) {
+
+  std::ofstream out(path);
+  if (!out.good()) {
+    LOG(ERROR) << "Cannot open file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+  for (const auto& info : files) {
+    out << treeName << " " << info.path << " " << info.entries << " " << info.zipBytes;
+    for (const Long64_t icluster : info.clusters) {
+      out << " " << icluster;
+    }
+    out << "\n";
+  }
+}
+
+EntryRangeSplitter::FileInfo EntryRangeSplitter::readFile(const std::string& path) const {
+
+  std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+  if (!file || file->IsZombie()) {
+    LOG(ERROR) << "Cannot open file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+
+  FileInfo result = EntryRangeSplitter::readTree(*file, m_treeName);
+  result.path = path;
+
+  return result;
+}
+
+EntryRangeSplitter::FileInfo EntryRangeSplitter::readTree(TFile& file, const std::string& treeName) {
+
+  FileInfo result;
+  result.path = file.GetName();
+
+  // files without the tree (no selected events) have no entries
+  TTree* tree = file.Get<TTree>(treeName.c_str());
+  if (!tree) return result;
+
+  result.entries = tree->GetEntries();
+  result.zipBytes = tree->GetZipBytes();
+
+  auto clusters = tree->GetClusterIterator(0);
+  Long64_t start(0);
+  while ((start = clusters()) < result.entries) {
+    result.clusters.emplace_back(start);
+  }
+
+  return result;
+}
+
+Long64_t EntryRangeSplitter::selectedEnd() const {
+
+  Long64_t totalEntries(0);
+  for (const auto& info : m_files) {
+    totalEntries += info.entries;
+  }
+
+  return m_end < 0 ? totalEntries : std::min(m_end, totalEntries);
+}
+
+Long64_t EntryRangeSplitter::boundary(const std::size_t nJobs, const std::size_t jobIndex) const {
+
+  const Long64_t begin = std::min(m_begin, this->selectedEnd());
+  const Long64_t end = this->selectedEnd();
+  if (jobIndex == 0 || begin == end) return begin;
+  if (jobIndex >= nJobs) return end;
+
+  // selected entries of each file, the compressed bytes are assumed to be uniform within a file
+  std::vector<Long64_t> selected;
+  Long64_t totalEntries(0);
+  double totalBytes(0);
+  Long64_t offset(0);
+  for (const auto& info : m_files) {
+    const Long64_t entries = std::max(Long64_t(0), std::min(end, offset + info.entries) - std::max(begin, offset));
+    selected.emplace_back(entries);
+    totalEntries += entries;
+    if (entries > 0) totalBytes += static_cast<double>(info.zipBytes)*entries/info.entries;
+    offset += info.entries;
+  }
+
+  auto cost = [totalEntries, totalBytes](const FileInfo& info, const Long64_t entries) {
+    if (entries == 0) return 0.;
+    double result = static_cast<double>(entries)/totalEntries;
+    if (totalBytes > 0) result += static_cast<double>(info.zipBytes)*entries/info.entries/totalBytes;
+    return result;
+  };
+
+  double totalCost(0);
+  for (std::size_t ifile = 0; ifile < m_files.size(); ++ifile) {
+    totalCost += cost(m_files.at(ifile), selected.at(ifile));
+  }
+  const double target = totalCost*jobIndex/nJobs;
+
+  // find the file where the cumulative cost reaches the target
+  double cumulative(0);
+  offset = 0;
+  for (std::size_t ifile = 0; ifile < m_files.size(); ++ifile) {
+    const FileInfo& info = m_files.at(ifile);
+    const double fileCost = cost(info, selected.at(ifile));
+    if (selected.at(ifile) == 0 || cumulative + fileCost < target) {
+      cumulative += fileCost;
+      offset += info.entries;
+      continue;
+    }
+
+    const Long64_t fileBegin = std::max(begin, offset) - offset;
+    const Long64_t fileEnd = std::min(end, offset + info.entries) - offset;
+    const Long64_t entry = fileBegin + static_cast<Long64_t>(std::llround((target - cumulative)/fileCost*selected.at(ifile)));
+
+    // closest cluster boundary within the selection, the end of the selection is a boundary too
+    Long64_t best = fileEnd;
+    for (const Long64_t icluster : info.clusters) {
+      if (icluster < fileBegin || icluster > fileEnd) continue;
+      if (std::llabs(icluster - entry) < std::llabs(best - entry)) best = icluster;
+    }
+
+    return offset + best;
+  }
+
+  return end;
+}
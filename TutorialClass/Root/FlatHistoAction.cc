@@ -0,0 +1,80 @@
+#include "TutorialClass/FlatHistoAction.h"
+
+#include "TH1.h"
+
+#include <cmath>
+
+FlatHistoResult::FlatHistoResult(const std::vector<HistoAxis>& axes, const std::size_t nSamples) :
+  m_axes(axes),
+  m_stats{},
+  m_entries(0.),
+  m_samples(nSamples)
+{
+  std::size_t cells(1);
+  for (const auto& iaxis : m_axes) {
+    cells *= iaxis.nbinsWithFlows();
+  }
+  m_sumW.resize(cells, 0.);
+  m_sumW2.resize(cells, 0.);
+}
+
+std::size_t FlatHistoResult::cell(const double* values, bool* inRange) const {
+  // same as TH1::GetBin: binx + (nx+2)*(biny + (ny+2)*binz)
+  std::size_t result(0);
+  for (std::size_t i = m_axes.size(); i-- > 0;) {
+    const std::size_t bin = m_axes[i].findBin(values[i]);
+    if (inRange && (bin == 0 || bin > m_axes[i].nbins())) *inRange = false;
+    result = result*m_axes[i].nbinsWithFlows() + bin;
+  }
+
+  return result;
+}
+
+void FlatHistoResult::add(const std::vector<double>& sumW,
+                          const std::vector<double>& sumW2,
+                          const Stats& stats,
+                          const double entries,
+                          const double scale) {
+  for (std::size_t i = 0; i < m_sumW.size(); ++i) {
+    m_sumW[i]  += scale*sumW[i];
+    m_sumW2[i] += scale*scale*sumW2[i];
+  }
+
+  // sumw2 scales with the squared scale, all other statistics are linear in the weight
+  for (std::size_t i = 0; i < nStats; ++i) {
+    m_stats[i] += (i == 1 ? scale*scale : scale)*stats[i];
+  }
+  m_entries += entries;
+}
+
+void FlatHistoResult::addSample(const std::size_t sample,
+                                const std::vector<double>& sumW,
+                                const std::vector<double>& sumW2,
+                                const Stats& stats,
+                                const double entries) {
+  std::shared_ptr<FlatHistoResult>& result = m_samples.at(sample);
+  if (!result) result = std::make_shared<FlatHistoResult>(m_axes);
+  result->add(sumW, sumW2, stats, entries);
+}
+
+std::size_t FlatHistoResult::sampleBytes() const {
+  std::size_t result(0);
+  for (const auto& isample : m_samples) {
+    if (isample) result += (isample->m_sumW.size() + isample->m_sumW2.size())*sizeof(double);
+  }
+
+  return result;
+}
+
+void FlatHistoResult::fill(TH1* histo) const {
+  histo->Sumw2();
+  for (std::size_t i = 0; i < m_sumW.size(); ++i) {
+    histo->SetBinContent(i, m_sumW[i]);
+    histo->SetBinError(i, std::sqrt(m_sumW2[i]));
+  }
+
+  // SetBinContent resets the statistics, they are set afterwards
+  Stats stats = m_stats;
+  histo->PutStats(stats.data());
+  histo->SetEntries(m_entries);
+}
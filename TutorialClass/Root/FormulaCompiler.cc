@@ -0,0 +1,372 @@
+#include "TutorialClass/FormulaCompiler.h"
+#include "TutorialClass/Hash.h"
+
+#include "FastFrames/Logger.h"
+
+#include "RVersion.h"
+#include "TSystem.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <system_error>
+
+namespace {
+  /**
+   * @brief Move a file into the cache without replacing a file of another job.
+   * The names are keyed by the hash of the generated code, an existing file has the same content
+   *
+   * @param from
+   * @param to
+   */
+  void moveToCache(const std::filesystem::path& from, const std::filesystem::path& to) {
+    // a hard link fails if the target exists, unlike rename
+    std::error_code error;
+    std::filesystem::create_hard_link(from, to, error);
+    if (!error || error == std::errc::file_exists) {
+      std::filesystem::remove(from);
+      return;
+    }
+
+    // file systems without hard links
+    if (!std::filesystem::exists(to)) {
+      std::filesystem::rename(from, to);
+    }
+  }
+
+  /**
+   * @brief Check whether a formula contains a keyword as a token, outside of string and character literals
+   * (e.g. "return" but not the column "n_returned")
+   *
+   * @param formula
+   * @param keyword
+   * @return bool
+   */
+  bool containsKeyword(const std::string& formula, const std::string& keyword) {
+    std::size_t i(0);
+    while (i < formula.size()) {
+      const char c = formula.at(i);
+      if (c == '"' || c == '\'') {
+        std::size_t end = i + 1;
+        while (end < formula.size() && formula.at(end) != c) {
+          if (formula.at(end) == '\\') ++end;
+          ++end;
+        }
+        i = end + 1;
+        continue;
+      }
+
+      if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+        ++i;
+        continue;
+      }
+
+      const std::size_t begin = i;
+      while (i < formula.size() && (std::isalnum(static_cast<unsigned char>(formula.at(i))) || formula.at(i) == '_')) ++i;
+      if (formula.compare(begin, i - begin, keyword) == 0) return true;
+    }
+
+    return false;
+  }
+}
+
+FormulaCompiler::FormulaCompiler(const std::string& directory, const std::vector<std::string>& headers) :
+  m_directory(directory),
+  m_headers(headers),
+  m_nCompiled(0)
+{
+}
+
+void FormulaCompiler::readIndex() {
+  std::error_code error;
+  for (const auto& ifile : std::filesystem::directory_iterator(this->indexDirectory(), error)) {
+    // temporary files of the jobs writing the index
+    if (ifile.path().extension() != ".txt") continue;
+
+    std::ifstream in(ifile.path());
+    std::string symbol;
+    std::string library;
+    while (in >> symbol >> library) {
+      m_index[symbol] = library;
+    }
+  }
+
+  LOG(DEBUG) << "Number of compiled formulas in the cache: " << m_index.size() << "\n";
+}
+
+ROOT::RDF::RNode FormulaCompiler::define(ROOT::RDF::RNode node, const std::string& name, const std::string& formula) {
+  CompiledFunction function = this->find(node, formula, false);
+  if (!function) return node.Define(name, formula);
+
+  function(node, name);
+  return node;
+}
+
+ROOT::RDF::RNode FormulaCompiler::filter(ROOT::RDF::RNode node, const std::string& formula) {
+  CompiledFunction function = this->find(node, formula, true);
+  if (!function) return node.Filter(formula);
+
+  function(node, "");
+  return node;
+}
+
+std::vector<std::string> FormulaCompiler::columnsInFormula(ROOT::RDF::RNode node, const std::string& formula) {
+  std::vector<std::string> result;
+  std::set<std::string> found;
+
+  std::size_t i(0);
+  while (i < formula.size()) {
+    const char c = formula.at(i);
+
+    // skip string and character literals
+    if (c == '"' || c == '\'') {
+      std::size_t end = i + 1;
+      while (end < formula.size() && formula.at(end) != c) {
+        if (formula.at(end) == '\\') ++end;
+        ++end;
+      }
+      i = end + 1;
+      continue;
+    }
+
+    // skip numbers including suffixes, e.g. 1e3f
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+      while (i < formula.size() && (std::isalnum(static_cast<unsigned char>(formula.at(i))) || formula.at(i) == '.' || formula.at(i) == '_')) ++i;
+      continue;
+    }
+
+    if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_') {
+      ++i;
+      continue;
+    }
+
+    const std::size_t begin = i;
+    while (i < formula.size() && (std::isalnum(static_cast<unsigned char>(formula.at(i))) || formula.at(i) == '_')) ++i;
+    const std::string identifier = formula.substr(begin, i - begin);
+
+    // members, namespaces and qualified names are not columns
+    std::size_t before = begin;
+    while (before > 0 && std::isspace(static_cast<unsigned char>(formula.at(before - 1)))) --before;
+    if (before > 0 && formula.at(before - 1) == '.') continue;
+    if (before > 1 && formula.compare(before - 2, 2, "->") == 0) continue;
+    if (before > 1 && formula.compare(before - 2, 2, "::") == 0) continue;
+    if (formula.compare(i, 2, "::") == 0) continue;
+
+    if (found.find(identifier) != found.end()) continue;
+    if (!node.HasColumn(identifier)) continue;
+
+    found.emplace(identifier);
+    result.emplace_back(identifier);
+  }
+
+  return result;
+}
+
+void FormulaCompiler::compile() {
+  if (m_pending.empty()) return;
+
+  // other jobs may have compiled some of the formulas (or failed to) in the meantime
+  this->readIndex();
+  m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [this](const std::pair<std::string, std::string>& pending) {
+                    return m_index.find(pending.first) != m_index.end();
+                  }), m_pending.end());
+  if (m_pending.empty()) return;
+
+  LOG(INFO) << "Compiling " << m_pending.size() << " formulas into a shared library\n";
+  std::vector<std::string> failed;
+  this->compileBatch(m_pending, failed);
+
+  // failed formulas are stored in the index so that the next jobs do not try to compile them again
+  if (!failed.empty()) {
+    LOG(WARNING) << failed.size() << " formulas cannot be compiled, they will continue to be JIT compiled\n";
+    std::string symbols;
+    for (const auto& isymbol : failed) {
+      symbols += isymbol;
+    }
+    std::ostringstream name;
+    name << "failed_" << std::hex << std::setw(16) << std::setfill('0') << Hash::fnv1a(symbols);
+    std::vector<std::pair<std::string, std::string> > entries;
+    for (const auto& isymbol : failed) {
+      entries.emplace_back(isymbol, failedLibrary);
+    }
+    this->writeIndex(name.str(), entries);
+  }
+
+  m_pending.clear();
+}
+
+void FormulaCompiler::compileBatch(const std::vector<std::pair<std::string, std::string> >& formulas,
+                                   std::vector<std::string>& failed) {
+
+  std::ostringstream source;
+  source << "// Generated by FormulaCompiler, do not edit\n"
+         << "#include \"ROOT/RDataFrame.hxx\"\n"
+         << "#include \"ROOT/RVec.hxx\"\n"
+         << "#include \"Math/Vector4D.h\"\n"
+         << "#include \"TMath.h\"\n"
+         << "#include <cmath>\n"
+         << "#include <string>\n"
+         << "#include <vector>\n";
+  for (const auto& iheader : m_headers) {
+    source << "#include \"" << iheader << "\"\n";
+  }
+  source << "\nusing namespace ROOT::VecOps;\n";
+  for (const auto& [symbol, code] : formulas) {
+    source << "\n" << code;
+  }
+
+  std::ostringstream name;
+  name << "formulas_" << std::hex << std::setw(16) << std::setfill('0') << Hash::fnv1a(source.str());
+
+  // build in a private directory, several jobs may share the cache
+  const std::filesystem::path buildDirectory = std::filesystem::path(m_directory) / ("build_" + std::to_string(gSystem->GetPid()));
+  std::filesystem::create_directories(buildDirectory);
+  const std::string path = (buildDirectory / (name.str() + ".C")).string();
+  {
+    std::ofstream out(path);
+    out << source.str();
+  }
+
+  LOG(DEBUG) << "Compiling " << formulas.size() << " formulas from: " << path << "\n";
+  if (gSystem->CompileMacro(path.c_str(), "kO", "", buildDirectory.string().c_str()) != 1) {
+    std::filesystem::remove_all(buildDirectory);
+    if (formulas.size() == 1) {
+      LOG(DEBUG) << "Cannot compile formula: " << formulas.front().second << "\n";
+      failed.emplace_back(formulas.front().first);
+      return;
+    }
+
+    // one formula that does not compile does not prevent compiling the others: bisect the batch
+    const auto middle = formulas.begin() + formulas.size()/2;
+    this->compileBatch({formulas.begin(), middle}, failed);
+    this->compileBatch({middle, formulas.end()}, failed);
+    return;
+  }
+
+  // move the library (and the files ACLiC needs next to it) into the cache
+  std::vector<std::filesystem::path> files;
+  for (const auto& ifile : std::filesystem::recursive_directory_iterator(buildDirectory)) {
+    if (ifile.is_regular_file()) files.emplace_back(ifile.path());
+  }
+  std::string library;
+  for (const auto& ifile : files) {
+    moveToCache(ifile, std::filesystem::path(m_directory) / ifile.filename());
+    if (ifile.extension() == ".so") library = ifile.filename().string();
+  }
+  std::filesystem::remove_all(buildDirectory);
+
+  if (library.empty()) {
+    LOG(WARNING) << "Cannot find the compiled library in: " << buildDirectory.string() << "\n";
+    return;
+  }
+
+  std::vector<std::pair<std::string, std::string> > entries;
+  for (const auto& iformula : formulas) {
+    entries.emplace_back(iformula.first, library);
+  }
+  this->writeIndex(name.str(), entries);
+  m_loaded.emplace(library);
+}
+
+void FormulaCompiler::writeIndex(const std::string& name, const std::vector<std::pair<std::string, std::string> >& entries) {
+
+  // one index file per library, written to a temporary file and renamed, readers never see a partial file
+  const std::filesystem::path indexDirectory(this->indexDirectory());
+  std::filesystem::create_directories(indexDirectory);
+  const std::filesystem::path temporary = indexDirectory / (name + "_" + std::to_string(gSystem->GetPid()) + ".tmp");
+  {
+    std::ofstream index(temporary);
+    for (const auto& [symbol, library] : entries) {
+      index << symbol << " " << library << "\n";
+    }
+  }
+  moveToCache(temporary, indexDirectory / (name + ".txt"));
+
+  for (const auto& [symbol, library] : entries) {
+    m_index[symbol] = library;
+  }
+}
+
+FormulaCompiler::CompiledFunction FormulaCompiler::find(ROOT::RDF::RNode node, const std::string& formula, const bool isFilter) {
+
+  const std::vector<std::string> columns = FormulaCompiler::columnsInFormula(node, formula);
+
+  // the generated code depends on the ROOT ABI and on the functions declared in the headers
+  std::string key = "ROOT" + std::to_string(ROOT_VERSION_CODE);
+  for (const auto& iheader : m_headers) {
+    key += "|" + iheader;
+  }
+  key += isFilter ? "|Filter|" : "|Define|";
+  key += formula;
+  std::vector<std::string> types;
+  for (const auto& icolumn : columns) {
+    types.emplace_back(node.GetColumnType(icolumn));
+    key += "|" + icolumn + ":" + types.back();
+  }
+
+  std::ostringstream symbolStream;
+  symbolStream << "ff_aot_" << std::hex << std::setw(16) << std::setfill('0') << Hash::fnv1a(key);
+  const std::string symbol = symbolStream.str();
+
+  auto itr = m_index.find(symbol);
+  if (itr != m_index.end() && itr->second == failedLibrary) return nullptr;
+  if (itr != m_index.end()) {
+    if (m_loaded.find(itr->second) == m_loaded.end()) {
+      const std::string library = (std::filesystem::path(m_directory) / itr->second).string();
+      if (gSystem->Load(library.c_str()) < 0) {
+        LOG(WARNING) << "Cannot load compiled formulas from: " << library << "\n";
+      }
+      m_loaded.emplace(itr->second);
+    }
+
+    void* function = gSystem->DynFindSymbol("*", symbol.c_str());
+    if (function) {
+      ++m_nCompiled;
+      return reinterpret_cast<CompiledFunction>(function);
+    }
+  }
+
+  // keep the code for the next compilation
+  for (const auto& ipending : m_pending) {
+    if (ipending.first == symbol) return nullptr;
+  }
+
+  std::string arguments;
+  std::string names;
+  for (std::size_t i = 0; i < columns.size(); ++i) {
+    if (i > 0) {
+      arguments += ", ";
+      names += ", ";
+    }
+    arguments += "const " + types.at(i) + "& " + columns.at(i);
+    names += "\"" + columns.at(i) + "\"";
+  }
+
+  // formulas with a return statement are used as function body, same as in RDataFrame
+  const bool hasReturn = containsKeyword(formula, "return");
+  const std::string body = hasReturn ? formula : "return " + formula + ";";
+
+  std::string comment = key;
+  std::replace(comment.begin(), comment.end(), '\n', ' ');
+  std::string code = "// " + comment + "\n";
+  code += "extern \"C\" void " + symbol + "(ROOT::RDF::RNode& node, const std::string& name) {\n";
+  if (isFilter) {
+    code += "  (void)name;\n";
+    code += "  node = node.Filter([](" + arguments + ") -> bool {" + body + "}, {" + names + "});\n";
+  } else {
+    code += "  node = node.Define(name, [](" + arguments + ") {" + body + "}, {" + names + "});\n";
+  }
+  code += "}\n";
+
+  m_pending.emplace_back(symbol, code);
+
+  return nullptr;
+}
+
+std::string FormulaCompiler::indexDirectory() const {
+  return (std::filesystem::path(m_directory) / "index").string();
+}
@@ -0,0 +1,54 @@
+#include "TutorialClass/HistoAxis.h"
+
+#include "FastFrames/Logger.h"
+#include "FastFrames/Variable.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+HistoAxis::HistoAxis(const Variable& variable) :
+  m_regular(variable.hasRegularBinning()),
+  m_nbins(0),
+  m_min(0),
+  m_max(0)
+{
+  if (m_regular) {
+    if (variable.axisNbins() <= 0) {
+      LOG(ERROR) << "Variable: " << variable.name() << " has no bins\n";
+      throw std::invalid_argument("");
+    }
+    m_nbins = variable.axisNbins();
+    m_min   = variable.axisMin();
+    m_max   = variable.axisMax();
+  } else {
+    m_edges = variable.binEdges();
+    if (m_edges.size() < 2) {
+      LOG(ERROR) << "Variable: " << variable.name() << " has less than 2 bin edges\n";
+      throw std::invalid_argument("");
+    }
+    m_nbins = m_edges.size() - 1;
+    m_min   = m_edges.front();
+    m_max   = m_edges.back();
+  }
+}
+
+std::size_t HistoAxis::findBin(const double value) const {
+  if (value < m_min) return 0;
+  if (!(value < m_max)) return m_nbins + 1; // also catches NaN, same as TAxis
+
+  if (m_regular) {
+    const std::size_t bin = 1 + static_cast<std::size_t>(m_nbins * (value - m_min) / (m_max - m_min));
+    return std::min(bin, m_nbins);
+  }
+
+  return static_cast<std::size_t>(std::upper_bound(m_edges.begin(), m_edges.end(), value) - m_edges.begin());
+}
+
+std::unique_ptr<TH1D> HistoAxis::emptyHisto(const std::string& name, const std::string& title) const {
+  std::unique_ptr<TH1D> result = m_regular ? std::make_unique<TH1D>(name.c_str(), title.c_str(), m_nbins, m_min, m_max) :
+                                             std::make_unique<TH1D>(name.c_str(), title.c_str(), m_nbins, m_edges.data());
+  result->SetDirectory(nullptr);
+  result->Sumw2();
+
+  return result;
+}
@@ -0,0 +1,99 @@
+#include "TutorialClass/InputSchemaCache.h"
+#include "TutorialClass/Hash.h"
+
+#include "FastFrames/Logger.h"
+
+#include "TSystem.h"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+InputSchemaCache::InputSchemaCache(const std::string& directory) :
+  m_directory(directory)
+{
+}
+
+bool InputSchemaCache::read(const std::string& path, const std::string& name, std::vector<std::string>& values) const {
+
+  std::string current;
+  if (!InputSchemaCache::stamp(path, current)) return false;
+
+  std::ifstream in(this->entryPath(path, name));
+  if (!in.good()) return false;
+
+  // the first lines identify the input, the hash of the file name may collide
+  std::string storedPath;
+  std::string storedStamp;
+  if (!std::getline(in, storedPath) || !std::getline(in, storedStamp)) return false;
+  if (storedPath != path || storedStamp != current) return false;
+
+  values.clear();
+  std::string line;
+  while (std::getline(in, line)) {
+    values.emplace_back(line);
+  }
+
+  LOG(DEBUG) << "Read " << name << " of file: " << path << " from the cache\n";
+
+  return true;
+}
+
+void InputSchemaCache::write(const std::string& path, const std::string& name, const std::vector<std::string>& values) const {
+
+  std::string current;
+  if (!InputSchemaCache::stamp(path, current)) return;
+
+  std::error_code error;
+  std::filesystem::create_directories(m_directory, error);
+  if (error) {
+    LOG(WARNING) << "Cannot create the input schema cache directory: " << m_directory << "\n";
+    return;
+  }
+
+  const std::string target = this->entryPath(path, name);
+  const std::string temporary = target + "." + std::to_string(gSystem->GetPid());
+  {
+    std::ofstream out(temporary);
+    out << path << "\n" << current << "\n";
+    for (const auto& ivalue : values) {
+      out << ivalue << "\n";
+    }
+    if (!out.good()) {
+      LOG(WARNING) << "Cannot write the input schema cache file: " << temporary << "\n";
+      return;
+    }
+  }
+
+  std::filesystem::rename(temporary, target, error);
+  if (error) {
+    LOG(WARNING) << "Cannot write the input schema cache file: " << target << "\n";
+    std::filesystem::remove(temporary, error);
+  }
+}
+
+bool InputSchemaCache::stamp(const std::string& path, std::string& stamp) {
+  std::error_code error;
+  const std::uintmax_t size = std::filesystem::file_size(path, error);
+  if (error) return false;
+  const auto time = std::filesystem::last_write_time(path, error);
+  if (error) return false;
+
+  stamp = std::to_string(size) + " " + std::to_string(time.time_since_epoch().count());
+
+  return true;
+}
+
+std::string InputSchemaCache::entryPath(const std::string& path, const std::string& name) const {
+  std::string safeName = name;
+  for (char& c : safeName) {
+    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') c = '_';
+  }
+
+  std::ostringstream file;
+  file << std::hex << std::setw(16) << std::setfill('0') << Hash::fnv1a(path) << "_" << safeName << ".txt";
+
+  return (std::filesystem::path(m_directory) / file.str()).string();
+}
@@ -0,0 +1,47 @@
+#include "TutorialClass/MappedFile.h"
+
+#include "FastFrames/Logger.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) :
+  m_data(nullptr),
+  m_size(0)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Cannot open file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    LOG(ERROR) << "Cannot read the size of file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+  m_size = info.st_size;
+
+  // empty files cannot be mapped
+  if (m_size == 0) {
+    ::close(fd);
+    return;
+  }
+
+  m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m_data == MAP_FAILED) {
+    m_data = nullptr;
+    LOG(ERROR) << "Cannot map file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_data) ::munmap(m_data, m_size);
+}
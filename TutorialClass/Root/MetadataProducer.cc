@@ -0,0 +1,203 @@
+#include "TutorialClass/MetadataProducer.h"
+
+#include "TutorialClass/SumWeightsTable.h"
+
+#include "FastFrames/Logger.h"
+#include "FastFrames/StringOperations.h"
+
+#include "TFile.h"
+#include "TH1.h"
+#include "TKey.h"
+#include "TROOT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+  /**
+   * @brief Simulation type from the data type label of the metadata histogram
+   *
+   * @param dataType
+   * @return std::string
+   */
+  std::string simulationType(const std::string& dataType) {
+    if (StringOperations::compare_case_insensitive(dataType, "data")) return "data";
+    if (StringOperations::compare_case_insensitive(dataType, "mc")) return "fullsim";
+    return "fastsim";
+  }
+}
+
+MetadataProducer::MetadataProducer(const std::size_t nThreads, const std::string& treeName) :
+  m_nThreads(std::max<std::size_t>(nThreads, 1)),
+  m_treeName(treeName),
+  m_nFiles(0)
+{
+}
+
+void MetadataProducer::scan(const std::vector<std::string>& directories) {
+
+  ROOT::EnableThreadSafety();
+
+  // list the directories in parallel, a shared file system has a high latency per directory
+  std::vector<std::future<std::vector<std::string> > > listings;
+  for (const auto& idirectory : directories) {
+    listings.emplace_back(std::async(std::launch::async, &MetadataProducer::findFiles, idirectory));
+  }
+  std::vector<std::string> files;
+  for (auto& ilisting : listings) {
+    const std::vector<std::string> found = ilisting.get();
+    files.insert(files.end(), found.begin(), found.end());
+  }
+
+  LOG(INFO) << "Reading the metadata of " << files.size() << " files with " << m_nThreads << " threads\n";
+
+  // each thread takes the next file, the results are stored per file
+  std::vector<FileMetadata> metadata(files.size());
+  std::atomic<std::size_t> next(0);
+  auto worker = [this, &files, &metadata, &next]() {
+    for (std::size_t i = next++; i < files.size(); i = next++) {
+      metadata.at(i) = MetadataProducer::readFile(files.at(i), m_treeName);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::size_t ithread = 0; ithread < std::min(m_nThreads, files.size()); ++ithread) {
+    threads.emplace_back(worker);
+  }
+  for (auto& ithread : threads) {
+    ithread.join();
+  }
+
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    const FileMetadata& imetadata = metadata.at(i);
+    if (!imetadata.valid) continue;
+    ++m_nFiles;
+
+    const UniqueSampleID id(imetadata.dsid, imetadata.campaign, imetadata.simulation);
+    m_filePaths[id].emplace_back(files.at(i));
+    m_fileEntries.emplace_back(imetadata.entries);
+    std::map<std::string, double>& sumWeights = m_sumWeights[id];
+    for (const auto& [variation, value] : imetadata.sumWeights) {
+      sumWeights[variation] += value;
+    }
+  }
+}
+
+void MetadataProducer::write(const std::string& outputDirectory) const {
+
+  std::filesystem::create_directories(outputDirectory);
+
+  const std::string fileListPath = (std::filesystem::path(outputDirectory) / "filelist.txt").string();
+  std::ofstream fileList(fileListPath);
+  if (!fileList.good()) {
+    LOG(ERROR) << "Cannot open file: " << fileListPath << "\n";
+    throw std::invalid_argument("");
+  }
+  for (const auto& [id, paths] : m_filePaths) {
+    for (const auto& ipath : paths) {
+      fileList << id << " " << ipath << "\n";
+    }
+  }
+
+  const std::string sumWeightsPath = (std::filesystem::path(outputDirectory) / "sum_of_weights.txt").string();
+  SumWeightsTable::Entries tableEntries;
+  {
+    std::ofstream sumWeights(sumWeightsPath);
+    if (!sumWeights.good()) {
+      LOG(ERROR) << "Cannot open file: " << sumWeightsPath << "\n";
+      throw std::invalid_argument("");
+    }
+    sumWeights << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (const auto& [id, variations] : m_sumWeights) {
+      if (id.isData()) continue;
+      for (const auto& [variation, value] : variations) {
+        sumWeights << id << " " << variation << " " << value << "\n";
+      }
+      tableEntries.emplace(id, variations);
+    }
+  }
+
+  // the text file is complete, its fingerprint is stored in the table
+  SumWeightsTable::write(SumWeightsTable::tablePath(sumWeightsPath), tableEntries, sumWeightsPath);
+
+  EntryRangeSplitter::writeFileEntries(EntryRangeSplitter::fileEntriesPath(outputDirectory), m_treeName, m_fileEntries);
+
+  LOG(INFO) << "Written metadata of " << m_filePaths.size() << " UniqueSampleIDs to: " << outputDirectory << "\n";
+}
+
+MetadataProducer::FileMetadata MetadataProducer::readFile(const std::string& path, const std::string& treeName) {
+
+  FileMetadata result;
+
+  std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+  if (!file || file->IsZombie()) {
+    LOG(WARNING) << "Cannot open file: " << path << ", skipping\n";
+    return result;
+  }
+
+  std::unique_ptr<TH1> metadata(file->Get<TH1>("metadata"));
+  if (!metadata || metadata->GetNbinsX() < 3) {
+    LOG(WARNING) << "File: " << path << " has no metadata histogram, skipping\n";
+    return result;
+  }
+  metadata->SetDirectory(nullptr);
+
+  result.simulation = simulationType(metadata->GetXaxis()->GetBinLabel(1));
+  result.campaign = metadata->GetXaxis()->GetBinLabel(2);
+  try {
+    result.dsid = std::stoi(metadata->GetXaxis()->GetBinLabel(3));
+  } catch (const std::exception&) {
+    LOG(WARNING) << "File: " << path << " has an invalid DSID in the metadata histogram, skipping\n";
+    return result;
+  }
+
+  // CutBookkeeper_<DSID>_<RUN>_<VARIATION>, the variation can contain "_"
+  const std::string prefix = "CutBookkeeper_";
+  for (const TObject* iobject : *file->GetListOfKeys()) {
+    const TKey* key = static_cast<const TKey*>(iobject);
+    const std::string name = key->GetName();
+    if (name.compare(0, prefix.size(), prefix) != 0) continue;
+
+    const std::size_t dsidEnd = name.find('_', prefix.size());
+    const std::size_t runEnd = dsidEnd == std::string::npos ? std::string::npos : name.find('_', dsidEnd + 1);
+    if (runEnd == std::string::npos) continue;
+
+    std::unique_ptr<TH1> histo(file->Get<TH1>(name.c_str()));
+    if (!histo) continue;
+    histo->SetDirectory(nullptr);
+    result.sumWeights[name.substr(runEnd + 1)] += histo->GetBinContent(2);
+  }
+
+  result.entries = EntryRangeSplitter::readTree(*file, treeName);
+  result.entries.path = path;
+  result.valid = true;
+
+  return result;
+}
+
+std::vector<std::string> MetadataProducer::findFiles(const std::string& directory) {
+
+  std::vector<std::string> result;
+  std::error_code error;
+  for (std::filesystem::recursive_directory_iterator itr(directory, error), end; !error && itr != end; itr.increment(error)) {
+    if (!itr->is_regular_file()) continue;
+    const std::string path = itr->path().string();
+    if (path.find(".root") == std::string::npos) continue;
+    result.emplace_back(path);
+  }
+  if (error) {
+    LOG(WARNING) << "Cannot read directory: " << directory << "\n";
+  }
+
+  std::sort(result.begin(), result.end());
+
+  return result;
+}
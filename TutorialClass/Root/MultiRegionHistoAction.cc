@@ -0,0 +1,7 @@
+#include "TutorialClass/MultiRegionHistoAction.h"
+
+MultiRegionHistoResult::MultiRegionHistoResult(const std::vector<HistoAxis>& axes) {
+  for (const auto& iaxis : axes) {
+    m_regions.emplace_back(std::vector<HistoAxis>{iaxis});
+  }
+}
@@ -0,0 +1,78 @@
+#include "TutorialClass/NormalisationTable.h"
+
+#include "FastFrames/ConfigSetting.h"
+#include "FastFrames/Logger.h"
+#include "FastFrames/MetadataManager.h"
+#include "FastFrames/Sample.h"
+#include "FastFrames/Systematic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+NormalisationTable::NormalisationTable(const ConfigSetting& config, const MetadataManager& metadataManager) {
+
+  for (const auto& isample : config.samples()) {
+    m_ids.insert(m_ids.end(), isample->uniqueSampleIDs().begin(), isample->uniqueSampleIDs().end());
+    m_variations.emplace_back(isample->nominalSumWeights());
+    for (const auto& isyst : isample->systematics()) {
+      m_variations.emplace_back(isyst->sumWeights());
+    }
+  }
+  std::sort(m_ids.begin(), m_ids.end());
+  m_ids.erase(std::unique(m_ids.begin(), m_ids.end(), [](const UniqueSampleID& a, const UniqueSampleID& b){return !(a < b) && !(b < a);}), m_ids.end());
+  std::sort(m_variations.begin(), m_variations.end());
+  m_variations.erase(std::unique(m_variations.begin(), m_variations.end()), m_variations.end());
+
+  m_values.assign(m_ids.size()*m_variations.size(), std::numeric_limits<double>::quiet_NaN());
+
+  // the normalisation only reads the sum of weights variation of the systematic
+  std::map<std::string, std::shared_ptr<Systematic> > variations;
+  for (const auto& ivariation : m_variations) {
+    auto syst = std::make_shared<Systematic>(ivariation);
+    syst->setSumWeights(ivariation);
+    variations.emplace(ivariation, syst);
+  }
+
+  // only the combinations used by the samples, other variations may not exist for the UniqueSampleID
+  for (const auto& isample : config.samples()) {
+    std::vector<std::string> used = {isample->nominalSumWeights()};
+    for (const auto& isyst : isample->systematics()) {
+      used.emplace_back(isyst->sumWeights());
+    }
+
+    for (const auto& id : isample->uniqueSampleIDs()) {
+      const std::size_t sample = this->sampleIndex(id);
+      for (const auto& ivariation : used) {
+        double& value = m_values.at(this->variationIndex(ivariation)*m_ids.size() + sample);
+        if (!std::isnan(value)) continue;
+        value = id.isData() ? 1. : metadataManager.normalisation(id, variations.at(ivariation));
+      }
+    }
+  }
+
+  LOG(INFO) << "Normalisation table with " << m_ids.size() << " UniqueSampleIDs and " << m_variations.size() << " sum of weights variations\n";
+}
+
+std::size_t NormalisationTable::sampleIndex(const UniqueSampleID& id) const {
+  auto itr = std::lower_bound(m_ids.begin(), m_ids.end(), id);
+  if (itr == m_ids.end() || id < *itr) {
+    LOG(ERROR) << "UniqueSampleID: " << id << " is not in the normalisation table\n";
+    throw std::invalid_argument("");
+  }
+
+  return std::distance(m_ids.begin(), itr);
+}
+
+std::size_t NormalisationTable::variationIndex(const std::string& sumWeights) const {
+  auto itr = std::lower_bound(m_variations.begin(), m_variations.end(), sumWeights);
+  if (itr == m_variations.end() || *itr != sumWeights) {
+    LOG(ERROR) << "Sum of weights variation: " << sumWeights << " is not in the normalisation table\n";
+    throw std::invalid_argument("");
+  }
+
+  return std::distance(m_variations.begin(), itr);
+}
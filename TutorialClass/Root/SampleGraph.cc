@@ -0,0 +1,2316 @@
+#include "TutorialClass/SampleGraph.h"
+
+#include "TutorialClass/EntryRangeSplitter.h"
+
+#include "FastFrames/Logger.h"
+#include "FastFrames/MainFrame.h"
+#include "FastFrames/Region.h"
+#include "FastFrames/Sample.h"
+#include "FastFrames/StringOperations.h"
+#include "FastFrames/Systematic.h"
+#include "FastFrames/UniqueSampleID.h"
+#include "FastFrames/Utils.h"
+#include "FastFrames/Variable.h"
+#include "FastFrames/VariableMacros.h"
+
+#include "Math/Vector4D.h"
+#include "ROOT/RVec.hxx"
+#include "TFile.h"
+#include "TH1.h"
+#include "TH1D.h"
+#include "TROOT.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <sstream>
+#include <utility>
+
+// Same as VariableMacros.h but booking FlatHistoAction
+#define ADD_FLAT_HISTO_1D_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::CodeType : \
+        result = bookFlatAction<CppType>(node, axes, columns, normalisations, m_unnormalisedHistos); \
+        break;
+
+#define ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(CodeType, CppType) \
+    ADD_FLAT_HISTO_1D_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::VECTOR_##CodeType : \
+        result = bookFlatAction<std::vector<CppType> >(node, axes, columns, normalisations, m_unnormalisedHistos); \
+        break; \
+    case VariableType::RVEC_##CodeType : \
+        result = bookFlatAction<ROOT::VecOps::RVec<CppType> >(node, axes, columns, normalisations, m_unnormalisedHistos); \
+        break;
+
+// Same as above, booking MultiRegionHistoAction
+#define ADD_MULTI_REGION_HISTO_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::CodeType : \
+        bookedResult = node.Book<CppType, double, ULong64_t>(MultiRegionHistoAction<CppType>(axes, bits), columns); \
+        break;
+
+#define ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(CodeType, CppType) \
+    ADD_MULTI_REGION_HISTO_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::VECTOR_##CodeType : \
+        bookedResult = node.Book<std::vector<CppType>, double, ULong64_t>(MultiRegionHistoAction<std::vector<CppType> >(axes, bits), columns); \
+        break; \
+    case VariableType::RVEC_##CodeType : \
+        bookedResult = node.Book<ROOT::VecOps::RVec<CppType>, double, ULong64_t>(MultiRegionHistoAction<ROOT::VecOps::RVec<CppType> >(axes, bits), columns); \
+        break;
+
+// Same as above, booking WeightVariationHistoAction
+#define ADD_WEIGHT_VARIATION_HISTO_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::CodeType : \
+        bookedResult = node.Book<CppType, ROOT::VecOps::RVec<double> >(WeightVariationHistoAction<CppType>(HistoAxis(variable), variable.title(), weightIndices), columns); \
+        break;
+
+#define ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(CodeType, CppType) \
+    ADD_WEIGHT_VARIATION_HISTO_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::VECTOR_##CodeType : \
+        bookedResult = node.Book<std::vector<CppType>, ROOT::VecOps::RVec<double> >(WeightVariationHistoAction<std::vector<CppType> >(HistoAxis(variable), variable.title(), weightIndices), columns); \
+        break; \
+    case VariableType::RVEC_##CodeType : \
+        bookedResult = node.Book<ROOT::VecOps::RVec<CppType>, ROOT::VecOps::RVec<double> >(WeightVariationHistoAction<ROOT::VecOps::RVec<CppType> >(HistoAxis(variable), variable.title(), weightIndices), columns); \
+        break;
+
+// Conversion of a column to double or ROOT::RVec<double> for the 2D and 3D FlatHistoAction
+#define ADD_FLAT_COLUMN_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::CodeType : \
+        node = node.Define(flatColumn, [](const CppType& value){return static_cast<double>(value);}, {column}); \
+        scalar = true; \
+        return true;
+
+#define ADD_FLAT_COLUMN_SUPPORT_VECTOR(CodeType, CppType) \
+    ADD_FLAT_COLUMN_SUPPORT_SCALAR(CodeType, CppType) \
+    case VariableType::VECTOR_##CodeType : \
+        node = node.Define(flatColumn, [](const std::vector<CppType>& values){return ROOT::VecOps::RVec<double>(values.begin(), values.end());}, {column}); \
+        scalar = false; \
+        return true; \
+    case VariableType::RVEC_##CodeType : \
+        node = node.Define(flatColumn, [](const ROOT::VecOps::RVec<CppType>& values){return ROOT::VecOps::RVec<double>(values.begin(), values.end());}, {column}); \
+        scalar = false; \
+        return true;
+
+// Packed column of the values of all systematics of a scalar variable
+#define ADD_PACKED_VALUES_SUPPORT(CodeType, CppType) \
+    case VariableType::CodeType : \
+        node = packColumns<double, CppType>(node, column, valueColumns, positions, m_systematics.size()); \
+        break;
+
+namespace {
+
+  /**
+   * @brief Number of columns read by one typed Define of a packed column
+   *
+   */
+  constexpr std::size_t packedChunkSize = 8;
+
+  template<std::size_t, typename T>
+  using Repeated = T;
+
+  /**
+   * @brief Add the identifier tokens of a formula (column names, functions, ...) to a set
+   *
+   * @param formula
+   * @param identifiers
+   */
+  void addIdentifiers(const std::string& formula, std::set<std::string>& identifiers) {
+    auto isIdentifier = [](const char c) {return std::isalnum(static_cast<unsigned char>(c)) || c == '_';};
+
+    std::size_t begin(0);
+    while (begin < formula.size()) {
+      if (!isIdentifier(formula.at(begin))) {
+        ++begin;
+        continue;
+      }
+      std::size_t end = begin;
+      while (end < formula.size() && isIdentifier(formula.at(end))) ++end;
+      identifiers.emplace(formula.substr(begin, end - begin));
+      begin = end;
+    }
+  }
+
+  /**
+   * @brief Preallocated per slot buffer of a packed column and the positions in it
+   * that each column read by a chunk is written to
+   *
+   */
+  template<typename Value>
+  class PackedBuffer {
+  public:
+    explicit PackedBuffer(const std::shared_ptr<std::vector<std::vector<Value> > >& buffers,
+                          const std::vector<std::vector<std::size_t> >& positions) :
+      m_buffers(buffers),
+      m_positions(positions) {}
+
+    ROOT::VecOps::RVec<Value> write(const unsigned int slot, const std::array<Value, packedChunkSize>& values) const {
+      std::vector<Value>& buffer = (*m_buffers)[slot];
+      for (std::size_t i = 0; i < m_positions.size(); ++i) {
+        for (const std::size_t position : m_positions[i]) {
+          buffer[position] = values[i];
+        }
+      }
+
+      // a view of the buffer, nothing is allocated per event
+      return ROOT::VecOps::RVec<Value>(buffer.data(), buffer.size());
+    }
+
+  private:
+    std::shared_ptr<std::vector<std::vector<Value> > > m_buffers;
+    std::vector<std::vector<std::size_t> > m_positions;
+  };
+
+  /**
+   * @brief Typed Define reading packedChunkSize columns of type T into a PackedBuffer.
+   * The chunks of a packed column are chained (each one reads the result of the previous chunk)
+   * so that the last chunk is only evaluated once all positions are written
+   *
+   */
+  template<typename Value, typename T, bool First, typename Indices = std::make_index_sequence<packedChunkSize> >
+  class PackedChunk;
+
+  template<typename Value, typename T, std::size_t... I>
+  class PackedChunk<Value, T, true, std::index_sequence<I...> > : public PackedBuffer<Value> {
+  public:
+    using PackedBuffer<Value>::PackedBuffer;
+
+    ROOT::VecOps::RVec<Value> operator()(const unsigned int slot, const Repeated<I, T>&... values) const {
+      return this->write(slot, {static_cast<Value>(values)...});
+    }
+  };
+
+  template<typename Value, typename T, std::size_t... I>
+  class PackedChunk<Value, T, false, std::index_sequence<I...> > : public PackedBuffer<Value> {
+  public:
+    using PackedBuffer<Value>::PackedBuffer;
+
+    ROOT::VecOps::RVec<Value> operator()(const unsigned int slot,
+                                         const ROOT::VecOps::RVec<Value>& /*previous*/,
+                                         const Repeated<I, T>&... values) const {
+      return this->write(slot, {static_cast<Value>(values)...});
+    }
+  };
+
+  /**
+   * @brief Define a ROOT::RVec<Value> column from columns of type T with typed Defines writing
+   * to preallocated per slot buffers. Positions not written by any column are 0
+   *
+   * @param node
+   * @param name Name of the packed column
+   * @param columns Distinct columns to read
+   * @param positions Per column, the positions it is written to
+   * @param size Size of the packed column
+   */
+  template<typename Value, typename T>
+  ROOT::RDF::RNode packColumns(ROOT::RDF::RNode node,
+                               const std::string& name,
+                               const std::vector<std::string>& columns,
+                               const std::vector<std::vector<std::size_t> >& positions,
+                               const std::size_t size) {
+
+    auto buffers = std::make_shared<std::vector<std::vector<Value> > >(node.GetNSlots(), std::vector<Value>(size, Value(0)));
+    if (columns.empty()) {
+      return node.DefineSlot(name, [buffers](const unsigned int slot) {
+                               std::vector<Value>& buffer = (*buffers)[slot];
+                               return ROOT::VecOps::RVec<Value>(buffer.data(), buffer.size());
+                             });
+    }
+
+    // the last chunk is padded with the last column, without positions to write to
+    const std::size_t nChunks = (columns.size() + packedChunkSize - 1)/packedChunkSize;
+    std::string previous;
+    for (std::size_t ichunk = 0; ichunk < nChunks; ++ichunk) {
+      std::vector<std::string> chunkColumns;
+      std::vector<std::vector<std::size_t> > chunkPositions;
+      for (std::size_t i = ichunk*packedChunkSize; i < (ichunk + 1)*packedChunkSize; ++i) {
+        chunkColumns.emplace_back(columns.at(std::min(i, columns.size() - 1)));
+        chunkPositions.emplace_back(i < columns.size() ? positions.at(i) : std::vector<std::size_t>{});
+      }
+
+      const std::string chunkName = ichunk + 1 == nChunks ? name : name + "_chunk" + std::to_string(ichunk);
+      if (ichunk == 0) {
+        node = node.DefineSlot(chunkName, PackedChunk<Value, T, true>(buffers, chunkPositions), chunkColumns);
+      } else {
+        chunkColumns.insert(chunkColumns.begin(), previous);
+        node = node.DefineSlot(chunkName, PackedChunk<Value, T, false>(buffers, chunkPositions), chunkColumns);
+      }
+      previous = chunkName;
+    }
+
+    return node;
+  }
+
+  /**
+   * @brief Book FlatHistoAction, with normalisations per UniqueSampleID the weight column
+   * is followed by the index of the UniqueSampleID
+   *
+   */
+  template<typename... ColumnTypes>
+  ROOT::RDF::RResultPtr<FlatHistoResult> bookFlatAction(ROOT::RDF::RNode& node,
+                                                        const std::vector<HistoAxis>& axes,
+                                                        const std::vector<std::string>& columns,
+                                                        const std::vector<double>& normalisations,
+                                                        const bool keepSamples) {
+    if (normalisations.empty()) {
+      return node.Book<ColumnTypes..., double>(FlatHistoAction<ColumnTypes...>(axes), columns);
+    }
+    return node.Book<ColumnTypes..., double, std::size_t>(FlatHistoAction<ColumnTypes...>(axes, normalisations, keepSamples), columns);
+  }
+
+  /**
+   * @brief Book FlatHistoAction on the converted columns, each being either double or ROOT::RVec<double>
+   *
+   */
+  template<typename... ColumnTypes>
+  ROOT::RDF::RResultPtr<FlatHistoResult> bookFlatConverted(ROOT::RDF::RNode& node,
+                                                           const std::vector<HistoAxis>& axes,
+                                                           const std::vector<std::string>& columns,
+                                                           const std::vector<bool>& scalars,
+                                                           const std::vector<double>& normalisations,
+                                                           const bool keepSamples) {
+    constexpr std::size_t n = sizeof...(ColumnTypes);
+    if constexpr (n < 3) {
+      if (n < scalars.size()) {
+        if (scalars.at(n)) return bookFlatConverted<ColumnTypes..., double>(node, axes, columns, scalars, normalisations, keepSamples);
+        return bookFlatConverted<ColumnTypes..., ROOT::VecOps::RVec<double> >(node, axes, columns, scalars, normalisations, keepSamples);
+      }
+    }
+    if constexpr (n > 0) {
+      return bookFlatAction<ColumnTypes...>(node, axes, columns, normalisations, keepSamples);
+    } else {
+      throw std::invalid_argument("No columns to fill");
+    }
+  }
+
+  /**
+   * @brief Translate the type name reported by RDataFrame
+   *
+   */
+  VariableType typeFromName(std::string name) {
+    // scalar type | {scalar, std::vector, ROOT::RVec}
+    static const std::map<std::string, std::array<VariableType, 3> > types = {
+      {"char",               {VariableType::CHAR,          VariableType::VECTOR_CHAR,          VariableType::RVEC_CHAR}},
+      {"Char_t",             {VariableType::CHAR,          VariableType::VECTOR_CHAR,          VariableType::RVEC_CHAR}},
+      {"bool",               {VariableType::BOOL,          VariableType::UNDEFINED,            VariableType::UNDEFINED}},
+      {"Bool_t",             {VariableType::BOOL,          VariableType::UNDEFINED,            VariableType::UNDEFINED}},
+      {"int",                {VariableType::INT,           VariableType::VECTOR_INT,           VariableType::RVEC_INT}},
+      {"Int_t",              {VariableType::INT,           VariableType::VECTOR_INT,           VariableType::RVEC_INT}},
+      {"unsigned int",       {VariableType::UNSIGNED_INT,  VariableType::VECTOR_UNSIGNED_INT,  VariableType::RVEC_UNSIGNED_INT}},
+      {"UInt_t",             {VariableType::UNSIGNED_INT,  VariableType::VECTOR_UNSIGNED_INT,  VariableType::RVEC_UNSIGNED_INT}},
+      {"long long",          {VariableType::LONG_INT,      VariableType::VECTOR_LONG_INT,      VariableType::RVEC_LONG_INT}},
+      {"Long64_t",           {VariableType::LONG_INT,      VariableType::VECTOR_LONG_INT,      VariableType::RVEC_LONG_INT}},
+      {"unsigned long",      {VariableType::UNSIGNED,      VariableType::VECTOR_UNSIGNED,      VariableType::RVEC_UNSIGNED}},
+      {"ULong_t",            {VariableType::UNSIGNED,      VariableType::VECTOR_UNSIGNED,      VariableType::RVEC_UNSIGNED}},
+      {"unsigned long long", {VariableType::LONG_UNSIGNED, VariableType::VECTOR_LONG_UNSIGNED, VariableType::RVEC_LONG_UNSIGNED}},
+      {"ULong64_t",          {VariableType::LONG_UNSIGNED, VariableType::VECTOR_LONG_UNSIGNED, VariableType::RVEC_LONG_UNSIGNED}},
+      {"float",              {VariableType::FLOAT,         VariableType::VECTOR_FLOAT,         VariableType::RVEC_FLOAT}},
+      {"Float_t",            {VariableType::FLOAT,         VariableType::VECTOR_FLOAT,         VariableType::RVEC_FLOAT}},
+      {"double",             {VariableType::DOUBLE,        VariableType::VECTOR_DOUBLE,        VariableType::RVEC_DOUBLE}},
+      {"Double_t",           {VariableType::DOUBLE,        VariableType::VECTOR_DOUBLE,        VariableType::RVEC_DOUBLE}},
+    };
+
+    name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+    std::size_t container(0);
+    for (const std::string prefix : {"std::vector<", "vector<"}) {
+      if (name.rfind(prefix, 0) == 0 && name.back() == '>') {
+        name = name.substr(prefix.size(), name.size() - prefix.size() - 1);
+        container = 1;
+        break;
+      }
+    }
+    for (const std::string prefix : {"ROOT::VecOps::RVec<", "ROOT::RVec<"}) {
+      if (container == 0 && name.rfind(prefix, 0) == 0 && name.back() == '>') {
+        name = name.substr(prefix.size(), name.size() - prefix.size() - 1);
+        container = 2;
+        break;
+      }
+    }
+
+    for (const auto& [typeName, type] : types) {
+      std::string compact = typeName;
+      compact.erase(std::remove(compact.begin(), compact.end(), ' '), compact.end());
+      if (compact == name) return type.at(container);
+    }
+
+    return VariableType::UNDEFINED;
+  }
+}
+
+SampleGraph::SampleGraph(MainFrame& frame,
+                         const std::shared_ptr<ConfigSetting>& config,
+                         const MetadataManager& metadataManager,
+                         const NormalisationTable& normalisations,
+                         SystematicReplacer& systReplacer,
+                         const BatchedColumns* batchedColumns) noexcept :
+  m_frame(frame),
+  m_config(config),
+  m_metadataManager(metadataManager),
+  m_normalisations(normalisations),
+  m_systReplacer(systReplacer),
+  m_batchedColumns(batchedColumns)
+{
+}
+
+bool SampleGraph::isSupported(const std::shared_ptr<Sample>& sample,
+                              const std::shared_ptr<ConfigSetting>& config) {
+
+  if (sample->hasTruth()) return false;
+  if (sample->hasCutflows()) return false;
+  if (!config->simpleONNXInferences().empty()) return false;
+  // the event range applies per UniqueSampleID, a single global entry range can only represent it for one of them
+  if ((config->minEvent() >= 0 || config->maxEvent() >= 0) && sample->uniqueSampleIDs().size() > 1) return false;
+
+  // the user defines are added once for all UniqueSampleIDs, this is only correct if they do not depend on the UniqueSampleID
+  if (sample->uniqueSampleIDs().size() > 1 && !config->customOptions().getOption<bool>("id_independent_defines", false)) {
+    LOG(INFO) << "Sample: " << sample->name() << " has several UniqueSampleIDs, set the custom option id_independent_defines "
+              << "if the defines of the custom class do not depend on the UniqueSampleID\n";
+    return false;
+  }
+
+  return true;
+}
+
+void SampleGraph::processSample(const std::shared_ptr<Sample>& sample) {
+
+  const std::vector<UniqueSampleID>& ids = sample->uniqueSampleIDs();
+  if (ids.empty()) {
+    LOG(WARNING) << "Sample: " << sample->name() << " has no UniqueSampleIDs, skipping\n";
+    return;
+  }
+
+  if (m_config->numCPU() > 1 && !ROOT::IsImplicitMTEnabled()) {
+    ROOT::EnableImplicitMT(m_config->numCPU());
+  }
+
+  const std::vector<std::string>& firstFiles = m_metadataManager.filePaths(ids.front());
+  if (firstFiles.empty()) {
+    LOG(ERROR) << "UniqueSampleID: " << ids.front() << " has no input files\n";
+    throw std::runtime_error("");
+  }
+
+  const std::string schemaDirectory = m_config->customOptions().getOption<std::string>("schema_cache_directory", "");
+  if (schemaDirectory.empty()) {
+    m_schemaCache.reset();
+  } else if (!m_schemaCache) {
+    m_schemaCache = std::make_unique<InputSchemaCache>(schemaDirectory);
+  }
+
+  if (sample->automaticSystematics()) {
+    this->readAutomaticSystematics(sample);
+  }
+
+  LOG(INFO) << "Processing sample: " << sample->name() << " with " << ids.size() << " UniqueSampleIDs in a single graph\n";
+
+  m_flat = m_config->customOptions().getOption<bool>("flat_histograms", false);
+  m_postFillNormalisation = m_config->customOptions().getOption<bool>("post_fill_normalisation", false);
+  if (m_postFillNormalisation && !m_flat) {
+    LOG(WARNING) << "Option post_fill_normalisation requires flat_histograms, the normalisation is applied per event\n";
+    m_postFillNormalisation = false;
+  }
+  m_unnormalisedHistos = m_config->customOptions().getOption<bool>("unnormalised_histograms", false);
+  if (m_unnormalisedHistos && !m_postFillNormalisation) {
+    LOG(WARNING) << "Option unnormalised_histograms requires post_fill_normalisation, the histograms without normalisation are not written\n";
+    m_unnormalisedHistos = false;
+  }
+  m_vectorised = m_config->customOptions().getOption<bool>("vectorised_systematics", false);
+  m_dryRun = m_config->customOptions().getOption<bool>("dry_run", false);
+  m_regionMask = m_config->customOptions().getOption<bool>("region_bitmask", false);
+  if (m_regionMask && m_vectorised) {
+    LOG(WARNING) << "Option region_bitmask is not used together with vectorised_systematics\n";
+    m_regionMask = false;
+  }
+  m_bulkWeights = m_config->customOptions().getOption<bool>("bulk_weight_variations", false);
+  if (m_bulkWeights && (m_vectorised || m_regionMask)) {
+    LOG(WARNING) << "Option bulk_weight_variations is not used together with vectorised_systematics or region_bitmask\n";
+    m_bulkWeights = false;
+  }
+  m_aggregatedGroups.clear();
+  std::string aggregated = m_config->customOptions().getOption<std::string>("aggregated_weight_variations", "");
+  StringOperations::stripString(&aggregated);
+  if (!aggregated.empty()) {
+    if (m_bulkWeights) {
+      m_aggregatedGroups = SampleGraph::aggregationGroups(aggregated);
+    } else {
+      LOG(WARNING) << "Option aggregated_weight_variations requires bulk_weight_variations, all variations are written\n";
+    }
+  }
+  if (m_regionMask && sample->regions().size() > 64) {
+    LOG(WARNING) << "Sample: " << sample->name() << " has more than 64 regions, region_bitmask is not used\n";
+    m_regionMask = false;
+  }
+  if (m_config->customOptions().getOption<bool>("aot_formulas", false)) {
+    if (!m_compiler) {
+      const std::string headers = m_config->customOptions().getOption<std::string>("aot_headers", "");
+      m_compiler = std::make_unique<FormulaCompiler>(m_config->customOptions().getOption<std::string>("aot_directory", "FastFramesAOT"),
+                                                     headers.empty() ? std::vector<std::string>() : StringOperations::splitAndStripString(headers, ","));
+      m_compiler->readIndex();
+    }
+  } else {
+    m_compiler.reset();
+  }
+
+  // a job without files or entries of the Sample writes no output for it, the same dataset is used by all batches
+  const std::optional<ROOT::RDF::Experimental::RDatasetSpec> spec = this->dataSpec(sample, m_jobInputs);
+  if (!spec) {
+    LOG(WARNING) << "Sample: " << sample->name() << " has no entries to process in job: " << m_config->currentJobIndex()
+                 << "/" << m_config->totalJobSplits() << ", skipping\n";
+    return;
+  }
+
+  const std::vector<std::vector<std::shared_ptr<Systematic> > > batches = this->systematicBatches(sample);
+  if (batches.size() > 1) {
+    LOG(INFO) << "Sample: " << sample->name() << " will be processed in " << batches.size() << " event loops to fit the memory budget\n";
+  }
+
+  // the Sample keeps all its systematics, each batch is processed as if it only had the systematics of the batch
+  for (std::size_t ibatch = 0; ibatch < batches.size(); ++ibatch) {
+    if (batches.size() > 1) {
+      LOG(INFO) << "Processing batch " << ibatch + 1 << "/" << batches.size() << " with " << batches.at(ibatch).size() << " systematics\n";
+    }
+    this->processBatch(sample, *spec, batches.at(ibatch), ibatch == 0);
+  }
+}
+
+std::size_t SampleGraph::histogramMemory(const std::shared_ptr<Sample>& sample,
+                                         const std::shared_ptr<Systematic>& systematic) const {
+
+  const std::size_t nSlots = ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : std::max(m_config->numCPU(), 1);
+  const std::vector<std::string>& sampleVariables = sample->variables();
+
+  std::size_t cells(0);
+  std::size_t histos(0);
+  for (const auto& region : sample->regions()) {
+    if (sample->skipSystematicRegionCombination(systematic, region)) continue;
+
+    for (const auto& variable : region->variables()) {
+      if (!systematic->isNominal() && variable.isNominalOnly()) continue;
+      if (!sampleVariables.empty() &&
+          std::find(sampleVariables.begin(), sampleVariables.end(), variable.name()) == sampleVariables.end()) continue;
+      cells += HistoAxis(variable).nbinsWithFlows();
+      ++histos;
+    }
+
+    for (const auto& [name1, name2] : region->variableCombinations()) {
+      const Variable& v1 = region->variableByName(name1);
+      const Variable& v2 = region->variableByName(name2);
+      if (!systematic->isNominal() && (v1.isNominalOnly() || v2.isNominalOnly())) continue;
+      cells += HistoAxis(v1).nbinsWithFlows()*HistoAxis(v2).nbinsWithFlows();
+      ++histos;
+    }
+
+    for (const auto& [name1, name2, name3] : region->variableCombinations3D()) {
+      const Variable& v1 = region->variableByName(name1);
+      const Variable& v2 = region->variableByName(name2);
+      const Variable& v3 = region->variableByName(name3);
+      if (!systematic->isNominal() && (v1.isNominalOnly() || v2.isNominalOnly() || v3.isNominalOnly())) continue;
+      cells += HistoAxis(v1).nbinsWithFlows()*HistoAxis(v2).nbinsWithFlows()*HistoAxis(v3).nbinsWithFlows();
+      ++histos;
+    }
+  }
+
+  // the content without normalisation of each UniqueSampleID is only kept for the re-normalisation cache
+  const std::size_t nSamples = m_unnormalisedHistos ? sample->uniqueSampleIDs().size() : 0;
+
+  return SampleGraph::histogramBytes(cells, histos, nSlots, nSamples, m_flat);
+}
+
+std::size_t SampleGraph::histogramBytes(const std::size_t cells,
+                                        const std::size_t histos,
+                                        const std::size_t nSlots,
+                                        const std::size_t nSamples,
+                                        const bool flat) {
+
+  // TH1D/TH2D/TH3D keep sum of weights and sum of squared weights per cell
+  // plus the object itself, one per slot, flat histograms are allocated per slot only when filled
+  // and per UniqueSampleID when the content without normalisation is kept
+  static constexpr std::size_t bytesPerCell = 2*sizeof(double);
+  static constexpr std::size_t bytesPerHisto = 1024;
+
+  if (flat) return (nSlots + nSamples)*cells*bytesPerCell;
+
+  return nSlots*(cells*bytesPerCell + histos*bytesPerHisto);
+}
+
+void SampleGraph::processBatch(const std::shared_ptr<Sample>& sample,
+                               const ROOT::RDF::Experimental::RDatasetSpec& spec,
+                               const std::vector<std::shared_ptr<Systematic> >& systematics,
+                               const bool recreate) {
+
+  const std::vector<UniqueSampleID>& ids = sample->uniqueSampleIDs();
+  const std::vector<std::string>& firstFiles = m_metadataManager.filePaths(ids.front());
+
+  const auto start = std::chrono::steady_clock::now();
+  m_systematics = systematics;
+
+  // all UniqueSampleIDs share the same input structure
+  m_systIndex.reset();
+  m_systReplacer = this->readSystematicMap(firstFiles.front(), sample);
+  m_systIndex = std::make_unique<SystematicIndex>(m_systReplacer);
+
+  ROOT::RDataFrame df(spec);
+  ROOT::RDF::RNode mainNode = df;
+  m_plan = GraphPlan();
+  m_columnIdentity.clear();
+
+  mainNode = this->addNormalisation(mainNode, sample);
+  mainNode = this->addTLorentzVectors(mainNode);
+  mainNode = this->addCustomDefines(mainNode, sample);
+  mainNode = this->addWeightColumns(mainNode, sample);
+
+  m_vectorisedVariables.clear();
+  m_packedValues.clear();
+  m_regionNodes.clear();
+  if (m_vectorised) {
+    this->selectVectorisedVariables(mainNode, sample);
+    mainNode = this->addVectorisedColumns(mainNode, sample);
+  }
+
+  RegionFilters filters = this->applyFilters(mainNode, sample);
+
+  std::vector<FlatHisto> flatHistos;
+  std::vector<MultiRegionHisto> multiRegionHistos;
+  std::vector<WeightVariationHisto> weightVariationHistos;
+  std::vector<SystematicHisto> histos = this->bookHistograms(filters, flatHistos, multiRegionHistos, weightVariationHistos, sample);
+  std::vector<VectorisedHisto> vectorisedHistos;
+  if (m_vectorised) {
+    vectorisedHistos = this->bookVectorisedHistograms(sample);
+  }
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Graph for sample: " << sample->name() << " built in " << elapsed.count() << " s, systematic replacements: "
+            << m_systIndex->nLookups() << " (" << m_systIndex->nComputed() << " computed)\n";
+
+  if (m_dryRun) {
+    const std::vector<std::string> mainColumns = mainNode.GetDefinedColumnNames();
+    m_plan.defines = mainColumns.size();
+
+    // columns defined on nodes shared by several regions or systematics (e.g. the region bitmasks) are counted once
+    std::set<std::string> regionColumns;
+    for (const auto& iregion : filters) {
+      for (const auto& inode : iregion) {
+        if (!inode) continue;
+        ROOT::RDF::RNode node = *inode;
+        for (const auto& icolumn : node.GetDefinedColumnNames()) {
+          regionColumns.emplace(icolumn);
+        }
+      }
+    }
+    for (const auto& icolumn : mainColumns) {
+      regionColumns.erase(icolumn);
+    }
+    m_plan.regionDefines = regionColumns.size();
+    m_plan.actions += vectorisedHistos.size();
+    this->printPlan(sample);
+  } else {
+    LOG(INFO) << "Triggering the event loop for sample: " << sample->name() << "\n";
+    this->writeHistosToFile(histos, flatHistos, multiRegionHistos, vectorisedHistos, weightVariationHistos, sample, recreate);
+    LOG(INFO) << "Number of event loops: " << df.GetNRuns() << ". For an optimal run, this number should be 1\n";
+  }
+
+  // the graph is built also in dry_run, a dry run fills the cache for the following runs
+  if (m_compiler) {
+    LOG(INFO) << "Sample: " << sample->name() << ", formulas using compiled code: " << m_compiler->nCompiled() << ", JIT compiled: " << m_compiler->nPending() << "\n";
+    m_compiler->compile();
+  }
+}
+
+std::optional<ROOT::RDF::Experimental::RDatasetSpec> SampleGraph::dataSpec(const std::shared_ptr<Sample>& sample,
+                                                                           std::vector<std::pair<std::string, double> >& inputs) const {
+
+  const std::vector<UniqueSampleID>& ids = sample->uniqueSampleIDs();
+  inputs.clear();
+
+  // the position of the UniqueSampleID is stored in the metadata of its RSample, read by "sample_index_fastframes"
+  auto uniqueSample = [&sample, &ids](const std::size_t index, const std::vector<std::string>& files) {
+    std::ostringstream name;
+    name << ids.at(index);
+    ROOT::RDF::Experimental::RMetaData metadata;
+    metadata.Add(SampleGraph::sampleIndexKey, static_cast<int>(index));
+    return ROOT::RDF::Experimental::RSample(name.str(), sample->recoTreeName(), files, metadata);
+  };
+
+  // same file selection per UniqueSampleID as MetadataManager::dataSpec
+  auto jobFiles = [this](const UniqueSampleID& id) {
+    const std::vector<std::string>& files = m_metadataManager.filePaths(id);
+    if (m_config->totalJobSplits() <= 0) return files;
+    return Utils::selectedFileList(files, m_config->totalJobSplits(), m_config->currentJobIndex());
+  };
+
+  const bool eventRange = m_config->minEvent() >= 0 || m_config->maxEvent() >= 0;
+  const bool balanced = m_config->totalJobSplits() > 1 && m_config->customOptions().getOption<bool>("balanced_job_splitting", false);
+  if (!eventRange && !balanced) {
+    ROOT::RDF::Experimental::RDatasetSpec result;
+    bool empty(true);
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+      const std::vector<std::string> files = jobFiles(ids.at(i));
+      if (files.empty()) continue;
+      for (const auto& ipath : files) {
+        inputs.emplace_back(ipath, 1.);
+      }
+      result.AddSample(uniqueSample(i, files));
+      empty = false;
+    }
+    if (empty) return std::nullopt;
+    return result;
+  }
+
+  // with balanced_job_splitting the entries of all files of all UniqueSampleIDs are split together,
+  // so the jobs have similar costs even if the UniqueSampleIDs have very different sizes.
+  // Otherwise every job keeps its files and the event range applies to them, as in the standard processing
+  const std::size_t nJobs = balanced ? m_config->totalJobSplits() : 1;
+  const std::size_t jobIndex = balanced ? std::max(0, m_config->currentJobIndex()) : 0;
+
+  // the entries of the files are taken from the table written by produce-metadata next to the file list
+  EntryRangeSplitter splitter(sample->recoTreeName(), m_schemaCache.get());
+  const std::string fileEntriesPath = EntryRangeSplitter::fileEntriesPath(std::filesystem::path(m_config->inputFilelistPath()).parent_path().string());
+  const bool fileEntries = splitter.readFileEntries(fileEntriesPath);
+  std::vector<std::size_t> fileIds;
+  for (std::size_t i = 0; i < ids.size(); ++i) {
+    for (const auto& ipath : balanced ? m_metadataManager.filePaths(ids.at(i)) : jobFiles(ids.at(i))) {
+      splitter.addFile(ipath);
+      fileIds.emplace_back(i);
+    }
+  }
+  if (splitter.nOpenedFiles() > 0) {
+    LOG(WARNING) << "Sample: " << sample->name() << ", " << splitter.nOpenedFiles() << " of " << fileIds.size() << " input files were opened to read their entries"
+                 << (fileEntries ? ", they are not in: " : ", no table: ") << fileEntriesPath
+                 << " (written by produce-metadata" << (m_schemaCache ? ")" : "), set schema_cache_directory to keep them for the next jobs") << "\n";
+  }
+
+  // same convention as RDF Range: a non-positive end means until the last entry
+  if (eventRange) {
+    splitter.selectEntries(std::max(0LL, m_config->minEvent()), m_config->maxEvent() > 0 ? m_config->maxEvent() : -1);
+  }
+
+  const std::vector<EntryRange> ranges = splitter.jobRanges(nJobs, jobIndex);
+  if (ranges.empty()) return std::nullopt;
+
+  ROOT::RDF::Experimental::RDatasetSpec result;
+
+  // the ranges are contiguous: only the first and the last file are partially processed
+  Long64_t offset(0);
+  std::vector<std::string> files;
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    const EntryRange& range = ranges.at(i);
+    files.emplace_back(range.path);
+    const Long64_t entries = splitter.entries(range.file);
+    inputs.emplace_back(range.path, entries > 0 ? static_cast<double>(range.end - range.begin)/entries : 0.);
+    const bool last = i + 1 == ranges.size();
+    if (last || fileIds.at(ranges.at(i + 1).file) != fileIds.at(range.file)) {
+      result.AddSample(uniqueSample(fileIds.at(range.file), files));
+      files.clear();
+    }
+    if (!last) offset += entries;
+  }
+
+  const Long64_t begin = ranges.front().begin;
+  const Long64_t end = offset + ranges.back().end;
+  LOG(INFO) << "Sample: " << sample->name() << ", job: " << m_config->currentJobIndex() << "/" << m_config->totalJobSplits() << " processes "
+            << ranges.size() << " files, entries [" << begin << ", " << end << ") of the selected files\n";
+  result.WithGlobalRange({begin, end});
+
+  return result;
+}
+
+void SampleGraph::printPlan(const std::shared_ptr<Sample>& sample) const {
+
+  std::size_t memory(0);
+  for (const auto& isyst : m_systematics) {
+    memory += this->histogramMemory(sample, isyst);
+  }
+
+  // the files of this job scaled by the fraction of their entries it processes,
+  // an upper bound of what is read as not all branches are read. Only local files are counted
+  double bytes(0);
+  std::size_t remoteFiles(0);
+  for (const auto& [path, fraction] : m_jobInputs) {
+    std::error_code error;
+    const std::uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) {
+      ++remoteFiles;
+      continue;
+    }
+    bytes += fraction*size;
+  }
+
+  LOG(INFO) << "Dry run plan for sample: " << sample->name() << " (" << m_systematics.size() << " systematics)\n";
+  LOG(INFO) << "  Defines on the main branch: " << m_plan.defines << ", distinct columns defined after the region selections: " << m_plan.regionDefines << "\n";
+  LOG(INFO) << "  Filters: " << m_plan.filters << "\n";
+  LOG(INFO) << "  Booked actions: " << m_plan.actions << "\n";
+  LOG(INFO) << "  Estimated histogram memory: " << memory/(1024*1024) << " MB\n";
+  LOG(INFO) << "  Input size of job " << m_config->currentJobIndex() << "/" << m_config->totalJobSplits() << ": "
+            << static_cast<std::uintmax_t>(bytes)/(1024*1024) << " MB from " << m_jobInputs.size() << " files";
+  if (remoteFiles > 0) {
+    LOG(INFO) << " (" << remoteFiles << " files not accessible locally are not included)";
+  }
+  LOG(INFO) << "\n";
+  LOG(INFO) << "  Expressions compiled with JIT: " << m_plan.jitFormulas.size() << "\n";
+  for (const auto& iformula : m_plan.jitFormulas) {
+    LOG(INFO) << "    " << iformula << "\n";
+  }
+}
+
+std::vector<std::vector<std::shared_ptr<Systematic> > > SampleGraph::systematicBatches(const std::shared_ptr<Sample>& sample) const {
+
+  const double budgetMB = m_config->customOptions().getOption<double>("histogram_memory_budget_mb", 0.);
+  if (budgetMB <= 0) return {sample->systematics()};
+
+  const std::size_t budget = static_cast<std::size_t>(budgetMB*1024*1024);
+
+  std::vector<std::vector<std::shared_ptr<Systematic> > > result;
+  std::size_t batchMemory(0);
+  std::size_t totalMemory(0);
+  for (const auto& isyst : sample->systematics()) {
+    const std::size_t memory = this->histogramMemory(sample, isyst);
+    totalMemory += memory;
+    if (memory > budget) {
+      LOG(WARNING) << "Histograms of systematic: " << isyst->name() << " alone need " << memory/(1024*1024) << " MB, more than the budget of " << budgetMB << " MB\n";
+    }
+    if (result.empty() || batchMemory + memory > budget) {
+      result.emplace_back();
+      batchMemory = 0;
+    }
+    result.back().emplace_back(isyst);
+    batchMemory += memory;
+  }
+
+  LOG(INFO) << "Sample: " << sample->name() << ", estimated histogram memory: " << totalMemory/(1024*1024) << " MB, budget: " << budgetMB << " MB\n";
+
+  return result;
+}
+
+std::vector<std::string> SampleGraph::selectionTerms(const std::string& selection) {
+
+  std::string trimmed = selection;
+  trimmed.erase(0, trimmed.find_first_not_of(" \t\n"));
+  trimmed.erase(trimmed.find_last_not_of(" \t\n") + 1);
+
+  // an empty selection passes all events
+  if (trimmed.empty()) return {"true"};
+
+  // split at the top-level "&&", ignoring brackets and literals, only if the selection is a plain conjunction
+  std::vector<std::string> terms;
+  int depth(0);
+  std::size_t begin(0);
+  for (std::size_t i = 0; i < trimmed.size(); ++i) {
+    const char c = trimmed.at(i);
+    if (c == '"' || c == '\'') {
+      for (++i; i < trimmed.size() && trimmed.at(i) != c; ++i) {
+        if (trimmed.at(i) == '\\') ++i;
+      }
+      continue;
+    }
+    if (c == '(' || c == '[' || c == '{') ++depth;
+    if (c == ')' || c == ']' || c == '}') --depth;
+    if (depth != 0) continue;
+
+    // "||", "?:" and "," bind weaker than "&&", statements (e.g. "return") cannot be split either
+    if (c == '?' || c == ',' || c == ';' || trimmed.compare(i, 2, "||") == 0) return {trimmed};
+    if (trimmed.compare(i, 2, "&&") == 0) {
+      terms.emplace_back(trimmed.substr(begin, i - begin));
+      begin = i + 2;
+      ++i;
+    }
+  }
+  terms.emplace_back(trimmed.substr(begin));
+
+  std::vector<std::string> result;
+  for (auto& iterm : terms) {
+    iterm.erase(0, iterm.find_first_not_of(" \t\n"));
+    iterm.erase(iterm.find_last_not_of(" \t\n") + 1);
+    if (iterm.empty()) continue;
+
+    // a term fully enclosed in brackets can be split further
+    bool enclosed = iterm.front() == '(' && iterm.back() == ')';
+    int termDepth(0);
+    for (std::size_t i = 0; enclosed && i + 1 < iterm.size(); ++i) {
+      if (iterm.at(i) == '(') ++termDepth;
+      if (iterm.at(i) == ')') --termDepth;
+      if (termDepth == 0) enclosed = false;
+    }
+
+    if (enclosed && iterm.find('"') == std::string::npos && iterm.find('\'') == std::string::npos) {
+      const std::string inner = iterm.substr(1, iterm.size() - 2);
+      const std::vector<std::string> innerTerms = SampleGraph::selectionTerms(inner);
+      if (innerTerms.size() > 1 || innerTerms.front() != inner) {
+        result.insert(result.end(), innerTerms.begin(), innerTerms.end());
+        continue;
+      }
+    }
+    result.emplace_back(iterm);
+  }
+
+  // e.g. "&& a"
+  if (result.empty()) return {trimmed};
+
+  return result;
+}
+
+std::vector<std::string> SampleGraph::weightFactors(const std::string& weight) {
+
+  std::string trimmed = weight;
+  trimmed.erase(0, trimmed.find_first_not_of(" \t\n"));
+  trimmed.erase(trimmed.find_last_not_of(" \t\n") + 1);
+  if (trimmed.empty()) return {"1"};
+
+  // split at the top-level "*", only if the weight is a plain product
+  std::vector<std::string> terms;
+  int depth(0);
+  std::size_t begin(0);
+  for (std::size_t i = 0; i < trimmed.size(); ++i) {
+    const char c = trimmed.at(i);
+    if (c == '"' || c == '\'') return {trimmed};
+    if (c == '(' || c == '[' || c == '{') ++depth;
+    if (c == ')' || c == ']' || c == '}') --depth;
+    if (depth != 0) continue;
+    if (std::string("+-/%<>=!&|?:,^~").find(c) != std::string::npos) return {trimmed};
+    if (c == '*') {
+      terms.emplace_back(trimmed.substr(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+  terms.emplace_back(trimmed.substr(begin));
+
+  std::vector<std::string> result;
+  for (auto& iterm : terms) {
+    iterm.erase(0, iterm.find_first_not_of(" \t\n"));
+    iterm.erase(iterm.find_last_not_of(" \t\n") + 1);
+
+    // not a product (e.g. a dereference)
+    if (iterm.empty()) return {trimmed};
+
+    // a factor fully enclosed in brackets can be split further
+    bool enclosed = iterm.front() == '(' && iterm.back() == ')';
+    int termDepth(0);
+    for (std::size_t i = 0; enclosed && i + 1 < iterm.size(); ++i) {
+      if (iterm.at(i) == '(') ++termDepth;
+      if (iterm.at(i) == ')') --termDepth;
+      if (termDepth == 0) enclosed = false;
+    }
+
+    if (enclosed) {
+      const std::string inner = iterm.substr(1, iterm.size() - 2);
+      const std::vector<std::string> innerFactors = SampleGraph::weightFactors(inner);
+      if (innerFactors.size() > 1 || innerFactors.front() != inner) {
+        result.insert(result.end(), innerFactors.begin(), innerFactors.end());
+        continue;
+      }
+    }
+    result.emplace_back(iterm);
+  }
+
+  return result;
+}
+
+bool SampleGraph::readsColumn(const std::string& formula, const std::set<std::string>& columns) {
+  std::set<std::string> identifiers;
+  addIdentifiers(formula, identifiers);
+
+  return std::any_of(identifiers.begin(), identifiers.end(), [&columns](const std::string& identifier) {
+    return columns.find(identifier) != columns.end();
+  });
+}
+
+std::set<std::tuple<std::size_t, std::size_t, std::string> > SampleGraph::bookWeightVariationHistos(RegionFilters& filters,
+                                                                                                    const std::shared_ptr<Sample>& sample,
+                                                                                                    std::vector<WeightVariationHisto>& weightVariationHistos) const {
+
+  std::set<std::tuple<std::size_t, std::size_t, std::string> > result;
+  const std::vector<std::string>& sampleVariables = sample->variables();
+
+  for (std::size_t ireg = 0; ireg < sample->regions().size(); ++ireg) {
+    const auto& region = sample->regions().at(ireg);
+
+    for (const auto& variable : region->variables()) {
+      if (!sampleVariables.empty() &&
+          std::find(sampleVariables.begin(), sampleVariables.end(), variable.name()) == sampleVariables.end()) continue;
+
+      // (selection, filled column) | positions of the systematics
+      std::map<std::pair<std::string, std::string>, std::vector<std::size_t> > groups;
+      for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+        const auto& systematic = m_systematics.at(isyst);
+        if (sample->skipSystematicRegionCombination(systematic, region)) continue;
+        if (!systematic->isNominal() && variable.isNominalOnly()) continue;
+        groups[std::make_pair(this->systematicFilter(sample, systematic, region),
+                              this->systematicVariable(variable, systematic))].emplace_back(isyst);
+      }
+
+      for (const auto& [key, systematics] : groups) {
+        // weight column | variation, systematics with the same weight share the variation
+        std::map<std::string, std::size_t> weights;
+        std::vector<std::size_t> weightIndices;
+        std::vector<std::size_t> variations;
+        for (const std::size_t isyst : systematics) {
+          const auto [itr, inserted] = weights.emplace(this->systematicWeight(m_systematics.at(isyst)), weights.size());
+          if (inserted) weightIndices.emplace_back(isyst);
+          variations.emplace_back(itr->second);
+        }
+        if (weights.size() < 2) continue;
+
+        ROOT::RDF::RNode node = filters.at(ireg).at(systematics.front()).value();
+        const std::vector<std::string> columns = {key.second, "weights_fastframes"};
+        ROOT::RDF::RResultPtr<SystematicHistoResult> bookedResult;
+        switch (this->columnType(node, variable, key.second)) {
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_SCALAR(BOOL, bool)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(CHAR, char)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(INT, int)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(UNSIGNED_INT, unsigned int)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(LONG_INT, long long int)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(UNSIGNED, unsigned long)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(LONG_UNSIGNED, unsigned long long)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(FLOAT, float)
+          ADD_WEIGHT_VARIATION_HISTO_SUPPORT_VECTOR(DOUBLE, double)
+          default:
+            continue;
+        }
+
+        WeightVariationHisto histo;
+        histo.region = region;
+        histo.variableName = variable.name();
+        histo.variations = variations;
+        histo.result = bookedResult;
+        for (const std::size_t isyst : systematics) {
+          histo.systematics.emplace_back(m_systematics.at(isyst));
+          result.emplace(isyst, ireg, variable.name());
+        }
+        weightVariationHistos.emplace_back(std::move(histo));
+        m_plan.actions += 1;
+      }
+    }
+  }
+
+  LOG(INFO) << "Sample: " << sample->name() << ", " << weightVariationHistos.size() << " histograms filled for all weight variations at once\n";
+
+  return result;
+}
+
+SystematicReplacer SampleGraph::readSystematicMap(const std::string& path,
+                                                 const std::shared_ptr<Sample>& sample) {
+
+  std::vector<std::string> branches;
+  const std::string entry = "branches_" + sample->recoTreeName();
+  if (!m_schemaCache || !m_schemaCache->read(path, entry, branches)) {
+    std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+    if (!file || file->IsZombie()) {
+      LOG(ERROR) << "Cannot open file: " << path << "\n";
+      throw std::invalid_argument("");
+    }
+
+    SystematicReplacer reader;
+    reader.getBranchesFromFile(file, sample->recoTreeName());
+    branches = reader.allBranches();
+    if (m_schemaCache) m_schemaCache->write(path, entry, branches);
+  }
+
+  SystematicReplacer result;
+  for (const auto& ibranch : branches) {
+    result.addBranch(ibranch);
+  }
+
+  std::vector<std::string> systematics;
+  for (const auto& isyst : m_systematics) {
+    systematics.emplace_back(isyst->name());
+  }
+  const SystematicBranchMatcher matcher(systematics);
+
+  // samples and batches with the same branches and systematics have the same maps
+  const std::uint64_t schema = matcher.schemaHash(result.allBranches());
+  auto itr = m_replacerCache.find(schema);
+  if (itr != m_replacerCache.end()) {
+    LOG(DEBUG) << "Reusing the systematic map of an input with the same branches and systematics for sample: " << sample->name() << "\n";
+    return itr->second;
+  }
+
+  // only the branches with variations (and their nominal branches) can change the maps
+  const std::vector<std::string> affected = matcher.affectedBranches(result.allBranches());
+  LOG(DEBUG) << "Sample: " << sample->name() << ", branches: " << result.allBranches().size() << ", branches affected by systematics: " << affected.size() << "\n";
+  result.matchSystematicVariables(affected, m_systematics);
+  m_replacerCache.emplace(schema, result);
+
+  return result;
+}
+
+void SampleGraph::readAutomaticSystematics(const std::shared_ptr<Sample>& sample) const {
+
+  if (sample->nominalOnly()) return;
+
+  const std::string& path = m_metadataManager.filePaths(sample->uniqueSampleIDs().front()).front();
+
+  std::vector<std::string> names;
+  const std::string entry = "systematics_" + m_config->listOfSystematicsName();
+  if (!m_schemaCache || !m_schemaCache->read(path, entry, names)) {
+    std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+    if (!file || file->IsZombie()) {
+      LOG(ERROR) << "Cannot open file: " << path << "\n";
+      throw std::invalid_argument("");
+    }
+
+    std::unique_ptr<TH1> histo(file->Get<TH1>(m_config->listOfSystematicsName().c_str()));
+    if (!histo) {
+      LOG(ERROR) << "Cannot read histogram: " << m_config->listOfSystematicsName() << " from file: " << path << "\n";
+      throw std::invalid_argument("");
+    }
+    histo->SetDirectory(nullptr);
+
+    for (int ibin = 1; ibin <= histo->GetNbinsX(); ++ibin) {
+      names.emplace_back(histo->GetXaxis()->GetBinLabel(ibin));
+    }
+    if (m_schemaCache) m_schemaCache->write(path, entry, names);
+  }
+
+  for (const auto& name : names) {
+    if (name.empty() || name == "NOSYS") continue;
+    if (sample->hasSystematic(name)) continue;
+    if (sample->skipExcludedSystematic(name)) continue;
+
+    auto syst = std::make_shared<Systematic>(name);
+    syst->setSumWeights(sample->nominalSumWeights());
+    for (const auto& ireg : sample->regions()) {
+      syst->addRegion(ireg);
+    }
+    sample->addSystematic(syst);
+    m_config->addUniqueSystematic(syst);
+  }
+}
+
+ROOT::RDF::RNode SampleGraph::addNormalisation(ROOT::RDF::RNode node,
+                                               const std::shared_ptr<Sample>& sample) {
+
+  const std::size_t nIds = sample->uniqueSampleIDs().size();
+
+  return node.DefinePerSample("sample_index_fastframes",
+                              [nIds](unsigned int /*slot*/, const ROOT::RDF::RSampleInfo& info) {
+                                const int index = info.GetI(SampleGraph::sampleIndexKey);
+                                if (index < 0 || static_cast<std::size_t>(index) >= nIds) {
+                                  LOG(ERROR) << "Input: " << info.AsString() << " has no valid UniqueSampleID index in its metadata\n";
+                                  throw std::runtime_error("");
+                                }
+                                return static_cast<std::size_t>(index);
+                              });
+}
+
+ROOT::RDF::RNode SampleGraph::addTLorentzVectors(ROOT::RDF::RNode node) {
+
+  auto componentName = [this](const std::string& object, const std::string& component) {
+    const std::string systName = object + "_" + component + "_NOSYS";
+    if (m_systIndex->branchExists(systName)) return systName;
+    const std::string name = object + "_" + component;
+    if (m_systIndex->branchExists(name)) return name;
+
+    LOG(ERROR) << "Cannot find branch for: " << name << " needed for the TLorentzVector\n";
+    throw std::invalid_argument("");
+  };
+
+  for (const auto& object : m_config->tLorentzVectors()) {
+    const std::vector<std::string> branches = {componentName(object, "pt"),
+                                               componentName(object, "eta"),
+                                               componentName(object, "phi"),
+                                               componentName(object, "e")};
+
+    if (m_config->useRVec()) {
+      auto createTLV = [](const ROOT::VecOps::RVec<float>& pt,
+                          const ROOT::VecOps::RVec<float>& eta,
+                          const ROOT::VecOps::RVec<float>& phi,
+                          const ROOT::VecOps::RVec<float>& e) {
+        ROOT::VecOps::RVec<ROOT::Math::PtEtaPhiEVector> result;
+        result.reserve(pt.size());
+        for (std::size_t i = 0; i < pt.size(); ++i) {
+          result.emplace_back(pt.at(i), eta.at(i), phi.at(i), e.at(i));
+        }
+        return result;
+      };
+      node = m_frame.systematicDefine(node, object + "_TLV_NOSYS", createTLV, branches);
+    } else {
+      auto createTLV = [](const std::vector<float>& pt,
+                          const std::vector<float>& eta,
+                          const std::vector<float>& phi,
+                          const std::vector<float>& e) {
+        std::vector<ROOT::Math::PtEtaPhiEVector> result;
+        result.reserve(pt.size());
+        for (std::size_t i = 0; i < pt.size(); ++i) {
+          result.emplace_back(pt.at(i), eta.at(i), phi.at(i), e.at(i));
+        }
+        return result;
+      };
+      node = m_frame.systematicDefine(node, object + "_TLV_NOSYS", createTLV, branches);
+    }
+  }
+
+  return node;
+}
+
+ROOT::RDF::RNode SampleGraph::addCustomDefines(ROOT::RDF::RNode node,
+                                               const std::shared_ptr<Sample>& sample) {
+
+  // the defines do not depend on the UniqueSampleID (see isSupported)
+  const UniqueSampleID& id = sample->uniqueSampleIDs().front();
+
+  auto configDefines = [this, &sample](ROOT::RDF::RNode n) {
+    for (const auto& idefine : sample->customRecoDefines()) {
+      m_plan.jitFormulas.emplace_back(idefine->formula());
+      n = this->stringDefine(n, idefine->columnName(), idefine->formula());
+    }
+    return n;
+  };
+
+  if (!m_config->configDefineAfterCustomClass()) {
+    node = configDefines(node);
+  }
+
+  node = m_frame.defineVariables(node, sample, id);
+  node = this->addBatchedVariations(node, sample);
+
+  if (m_config->configDefineAfterCustomClass()) {
+    node = configDefines(node);
+  }
+
+  // variables that use a formula instead of a column
+  m_variablesWithFormula = Utils::variablesWithFormulaReco(node, sample);
+  for (const auto& [formula, name] : m_variablesWithFormula) {
+    m_plan.jitFormulas.emplace_back(formula);
+    node = this->stringDefine(node, name, formula);
+  }
+
+  return node;
+}
+
+ROOT::RDF::RNode SampleGraph::addBatchedVariations(ROOT::RDF::RNode node,
+                                                   const std::shared_ptr<Sample>& sample) {
+
+  if (!m_batchedColumns) return node;
+
+  // column of a single variation | nominal column of the batched define, position of the variation
+  std::map<std::string, std::pair<std::string, std::size_t> > variations;
+  for (const auto& [nominal, batched] : *m_batchedColumns) {
+    if (!node.HasColumn(batched.column)) continue;
+    for (std::size_t i = 0; i < batched.variations.size(); ++i) {
+      variations.emplace(StringOperations::replaceString(nominal, "NOSYS", batched.variations.at(i)), std::make_pair(nominal, i));
+    }
+  }
+  if (variations.empty()) return node;
+
+  // the formulas of the processed systematics read single variations
+  std::set<std::string> read;
+  for (const auto& isyst : m_systematics) {
+    addIdentifiers(this->replaceString(sample->weight(), isyst), read);
+    addIdentifiers(isyst->weightSuffix(), read);
+    for (const auto& ireg : sample->regions()) {
+      if (sample->skipSystematicRegionCombination(isyst, ireg)) continue;
+      addIdentifiers(this->systematicFilter(sample, isyst, ireg), read);
+      for (const auto& ivariable : ireg->variables()) {
+        addIdentifiers(this->replaceString(ivariable.definition(), isyst), read);
+      }
+    }
+  }
+
+  // the config defines and the variables with formula define all systematics affecting their inputs
+  std::set<std::string> readNominal;
+  for (const auto& idefine : sample->customRecoDefines()) {
+    addIdentifiers(idefine->formula(), readNominal);
+  }
+  for (const auto& ireg : sample->regions()) {
+    for (const auto& ivariable : ireg->variables()) {
+      std::set<std::string> identifiers;
+      addIdentifiers(ivariable.definition(), identifiers);
+      if (identifiers.size() == 1 && *identifiers.begin() == ivariable.definition()) continue;
+      readNominal.insert(identifiers.begin(), identifiers.end());
+    }
+  }
+
+  std::size_t nDefined(0);
+  for (const auto& [column, variation] : variations) {
+    const auto& [nominal, position] = variation;
+    if (read.count(column) == 0 && readNominal.count(nominal) == 0) continue;
+    if (node.HasColumn(column)) continue;
+    node = m_batchedColumns->at(nominal).defineVariation(node, position);
+    ++nDefined;
+  }
+
+  LOG(DEBUG) << "Sample: " << sample->name() << ", columns of single variations of the batched defines: " << nDefined
+             << " of " << variations.size() << "\n";
+
+  return node;
+}
+
+ROOT::RDF::RNode SampleGraph::stringDefine(ROOT::RDF::RNode node,
+                                           const std::string& name,
+                                           const std::string& formula) {
+
+  if (!m_compiler) {
+    return m_frame.systematicStringDefine(node, name, formula);
+  }
+
+  // same as MainFrame::systematicStringDefine, but the columns are booked by FormulaCompiler
+  if (name.find("NOSYS") == std::string::npos) {
+    LOG(ERROR) << "The new variable name: \"" << name << "\" does not contain \"NOSYS\"\n";
+    throw std::invalid_argument("");
+  }
+
+  const std::vector<std::string> columns = FormulaCompiler::columnsInFormula(node, formula);
+  const std::vector<std::string> effectiveSystematics = m_systReplacer.getListOfEffectiveSystematics(columns);
+
+  node = m_compiler->define(node, name, formula);
+  for (const auto& isystematic : effectiveSystematics) {
+    if (isystematic == "NOSYS") continue;
+    node = m_compiler->define(node,
+                              StringOperations::replaceString(name, "NOSYS", isystematic),
+                              m_systReplacer.replaceString(formula, isystematic));
+  }
+
+  if (!m_systIndex->branchExists(name)) {
+    m_systReplacer.addVariableAndEffectiveSystematics(name, effectiveSystematics);
+  }
+
+  return node;
+}
+
+ROOT::RDF::RNode SampleGraph::jitDefine(ROOT::RDF::RNode node,
+                                        const std::string& name,
+                                        const std::string& formula) const {
+
+  if (m_compiler) return m_compiler->define(node, name, formula);
+
+  return node.Define(name, formula);
+}
+
+ROOT::RDF::RNode SampleGraph::jitFilter(ROOT::RDF::RNode node,
+                                        const std::string& formula) const {
+
+  if (m_compiler) return m_compiler->filter(node, formula);
+
+  return node.Filter(formula);
+}
+
+ROOT::RDF::RNode SampleGraph::addWeightColumns(ROOT::RDF::RNode node,
+                                               const std::shared_ptr<Sample>& sample) {
+
+  std::vector<std::size_t> sampleIndices;
+  for (const auto& id : sample->uniqueSampleIDs()) {
+    sampleIndices.emplace_back(m_normalisations.sampleIndex(id));
+  }
+
+  // factor | position in "weight_factors_fastframes", each distinct factor is evaluated once per event
+  std::map<std::string, std::size_t> factors;
+
+  // sorted positions of the factors | position in "weight_products_fastframes"
+  std::map<std::vector<std::size_t>, std::size_t> products;
+
+  std::vector<std::size_t> systProducts;
+  for (const auto& isyst : m_systematics) {
+    std::vector<std::string> terms = SampleGraph::weightFactors(this->replaceString(sample->weight(), isyst));
+    if (!isyst->weightSuffix().empty()) {
+      const std::vector<std::string> suffix = SampleGraph::weightFactors(isyst->weightSuffix());
+      terms.insert(terms.end(), suffix.begin(), suffix.end());
+    }
+
+    std::vector<std::size_t> positions;
+    for (const auto& iterm : terms) {
+      positions.emplace_back(factors.emplace(iterm, factors.size()).first->second);
+    }
+    std::sort(positions.begin(), positions.end());
+    systProducts.emplace_back(products.emplace(positions, products.size()).first->second);
+  }
+
+  std::vector<std::string> orderedFactors(factors.size());
+  for (const auto& [factor, position] : factors) {
+    orderedFactors.at(position) = factor;
+  }
+  LOG(DEBUG) << "Sample: " << sample->name() << ", " << factors.size() << " weight factors for " << products.size() << " weights\n";
+
+  // one column per factor, packed into preallocated per slot buffers
+  std::vector<std::string> factorColumns;
+  std::vector<std::vector<std::size_t> > factorPositions;
+  for (std::size_t i = 0; i < orderedFactors.size(); ++i) {
+    const std::string column = "weight_factor_fastframes_" + std::to_string(i);
+    const std::string formula = "static_cast<double>(" + orderedFactors.at(i) + ")";
+    m_plan.jitFormulas.emplace_back(formula);
+    node = this->jitDefine(node, column, formula);
+    factorColumns.emplace_back(column);
+    factorPositions.emplace_back(std::vector<std::size_t>{i});
+  }
+  node = packColumns<double, double>(node, "weight_factors_fastframes", factorColumns, factorPositions, orderedFactors.size());
+
+  std::vector<std::vector<std::size_t> > productFactors(products.size());
+  for (const auto& [positions, product] : products) {
+    productFactors.at(product) = positions;
+  }
+  // the products and the weights of all systematics are written to preallocated per slot buffers
+  auto productBuffers = std::make_shared<std::vector<std::vector<double> > >(node.GetNSlots(), std::vector<double>(productFactors.size()));
+  node = node.DefineSlot("weight_products_fastframes",
+                         [productFactors, productBuffers](const unsigned int slot, const ROOT::VecOps::RVec<double>& values) {
+                           std::vector<double>& result = (*productBuffers)[slot];
+                           for (std::size_t i = 0; i < productFactors.size(); ++i) {
+                             result[i] = 1.;
+                             for (const std::size_t ifactor : productFactors[i]) {
+                               result[i] *= values[ifactor];
+                             }
+                           }
+                           return ROOT::VecOps::RVec<double>(result.data(), result.size());
+                         },
+                         {"weight_factors_fastframes"});
+
+  // product | column, systematics that do not change the weight formula reuse the column
+  std::map<std::size_t, std::string> formulas;
+
+  // (formula column, normalisations of the UniqueSampleIDs) | column, most systematics share the nominal sum of weights
+  std::map<std::pair<std::string, std::vector<double> >, std::string> defined;
+
+  m_unnormalisedWeights.clear();
+  std::vector<std::vector<double> > systNormalisations;
+
+  for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+    const auto& systematic = m_systematics.at(isyst);
+    const std::size_t product = systProducts.at(isyst);
+
+    auto formulaItr = formulas.find(product);
+    if (formulaItr == formulas.end()) {
+      const std::string formulaColumn = "weight_formula_fastframes_" + systematic->name();
+      node = node.Define(formulaColumn,
+                         [product](const ROOT::VecOps::RVec<double>& weights) {return weights[product];},
+                         {"weight_products_fastframes"});
+      formulaItr = formulas.emplace(product, formulaColumn).first;
+    }
+
+    const double* variation = m_normalisations.variation(m_normalisations.variationIndex(systematic->sumWeights()));
+    std::vector<double> normalisations;
+    for (const std::size_t index : sampleIndices) {
+      normalisations.emplace_back(variation[index]);
+    }
+    m_unnormalisedWeights.emplace(systematic->name(), std::make_pair(formulaItr->second, normalisations));
+    systNormalisations.emplace_back(normalisations);
+
+    const std::string column = "weight_total_" + systematic->name();
+    auto itr = defined.find(std::make_pair(formulaItr->second, normalisations));
+    if (itr != defined.end()) {
+      m_columnIdentity[column] = itr->second;
+      continue;
+    }
+    defined.emplace(std::make_pair(formulaItr->second, normalisations), column);
+
+    node = node.Define(column,
+                       [normalisations](const double weight, const std::size_t sampleIndex) {return weight*normalisations[sampleIndex];},
+                       {formulaItr->second, "sample_index_fastframes"});
+  }
+
+  // weights of all systematics in one column, read by the vectorised histograms
+  auto weightBuffers = std::make_shared<std::vector<std::vector<double> > >(node.GetNSlots(), std::vector<double>(systProducts.size()));
+  node = node.DefineSlot("weights_fastframes",
+                         [systProducts, systNormalisations, weightBuffers](const unsigned int slot,
+                                                                           const ROOT::VecOps::RVec<double>& weights,
+                                                                           const std::size_t sampleIndex) {
+                           std::vector<double>& result = (*weightBuffers)[slot];
+                           for (std::size_t i = 0; i < systProducts.size(); ++i) {
+                             result[i] = weights[systProducts[i]]*systNormalisations[i][sampleIndex];
+                           }
+                           return ROOT::VecOps::RVec<double>(result.data(), result.size());
+                         },
+                         {"weight_products_fastframes", "sample_index_fastframes"});
+
+  return node;
+}
+
+RegionFilters SampleGraph::applyFilters(ROOT::RDF::RNode node,
+                                       const std::shared_ptr<Sample>& sample) {
+
+  RegionFilters result;
+  const UniqueSampleID& id = sample->uniqueSampleIDs().front();
+
+  // terms of the selection so far (separated by new lines) | filter node
+  std::map<std::string, ROOT::RDF::RNode> filterTree;
+
+  if (m_regionMask) {
+    this->addRegionMasks(node, sample);
+  }
+
+  for (const auto& ireg : sample->regions()) {
+    std::vector<std::optional<ROOT::RDF::RNode> > perSystFilter;
+
+    if (m_vectorised) {
+      // one column with the decisions of all systematics, the filters only read it.
+      // Each distinct selection is evaluated once, skipped systematics keep the decision 0
+      const std::string passedColumn = "passed_fastframes_" + ireg->name();
+      ROOT::RDF::RNode regionNode = node;
+      std::map<std::string, std::size_t> selections;
+      std::vector<std::string> decisionColumns;
+      std::vector<std::vector<std::size_t> > positions;
+      for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+        const auto& systematic = m_systematics.at(isyst);
+        if (sample->skipSystematicRegionCombination(systematic, ireg)) continue;
+
+        const std::string selection = this->systematicFilter(sample, systematic, ireg);
+        const auto [itr, inserted] = selections.emplace(selection, decisionColumns.size());
+        if (inserted) {
+          const std::string column = passedColumn + "_" + std::to_string(decisionColumns.size());
+          m_plan.jitFormulas.emplace_back(selection);
+          regionNode = this->jitDefine(regionNode, column, "static_cast<bool>(" + selection + ")");
+          decisionColumns.emplace_back(column);
+          positions.emplace_back();
+        }
+        positions.at(itr->second).emplace_back(isyst);
+      }
+      m_plan.filters += 1;
+
+      regionNode = packColumns<char, bool>(regionNode, passedColumn, decisionColumns, positions, m_systematics.size())
+                     .Filter([](const ROOT::VecOps::RVec<char>& decisions) {return ROOT::VecOps::Any(decisions);},
+                             {passedColumn});
+      regionNode = m_frame.defineVariablesRegion(regionNode, sample, id, ireg->name());
+      m_regionNodes.emplace_back(regionNode);
+
+      for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+        if (sample->skipSystematicRegionCombination(m_systematics.at(isyst), ireg)) {
+          perSystFilter.emplace_back(std::nullopt);
+          continue;
+        }
+        m_plan.filters += 1;
+        perSystFilter.emplace_back(regionNode.Filter([isyst](const ROOT::VecOps::RVec<char>& decisions) {return decisions[isyst] != 0;},
+                                                     {passedColumn}));
+      }
+      result.emplace_back(std::move(perSystFilter));
+      continue;
+    }
+
+    if (m_regionMask) {
+      const ULong64_t bit = 1ull << result.size();
+      for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+        const auto& systematic = m_systematics.at(isyst);
+        if (sample->skipSystematicRegionCombination(systematic, ireg)) {
+          perSystFilter.emplace_back(std::nullopt);
+          continue;
+        }
+        m_plan.filters += 1;
+        ROOT::RDF::RNode filtered = m_maskNodes.at(isyst).Filter([bit](const ULong64_t mask) {return (mask & bit) != 0;},
+                                                                 {this->regionMaskColumn(systematic)});
+        filtered = m_frame.defineVariablesRegion(filtered, sample, id, ireg->name());
+        perSystFilter.emplace_back(std::move(filtered));
+      }
+      result.emplace_back(std::move(perSystFilter));
+      continue;
+    }
+
+    for (const auto& isyst : m_systematics) {
+      if (sample->skipSystematicRegionCombination(isyst, ireg)) {
+        perSystFilter.emplace_back(std::nullopt);
+        continue;
+      }
+
+      // one filter per term of the selection, the terms are shared with all the selections
+      // (any region and systematic) that start with the same terms
+      const std::vector<std::string> terms = SampleGraph::selectionTerms(this->systematicFilter(sample, isyst, ireg));
+      ROOT::RDF::RNode filtered = node;
+      std::string prefix;
+      for (const auto& iterm : terms) {
+        prefix += iterm + "\n";
+        auto itr = filterTree.find(prefix);
+        if (itr != filterTree.end()) {
+          filtered = itr->second;
+          continue;
+        }
+        m_plan.jitFormulas.emplace_back(iterm);
+        m_plan.filters += 1;
+        filtered = this->jitFilter(filtered, iterm);
+        filterTree.emplace(prefix, filtered);
+      }
+      filtered = m_frame.defineVariablesRegion(filtered, sample, id, ireg->name());
+      perSystFilter.emplace_back(std::move(filtered));
+    }
+    result.emplace_back(std::move(perSystFilter));
+  }
+
+  return result;
+}
+
+void SampleGraph::addRegionMasks(ROOT::RDF::RNode node,
+                                 const std::shared_ptr<Sample>& sample) {
+
+  m_maskNodes.clear();
+
+  // formula | position of the mask node, systematics that change no selection reuse the node
+  std::map<std::string, std::size_t> defined;
+  for (const auto& isyst : m_systematics) {
+    std::string mask;
+    for (std::size_t ireg = 0; ireg < sample->regions().size(); ++ireg) {
+      const auto& region = sample->regions().at(ireg);
+      if (sample->skipSystematicRegionCombination(isyst, region)) continue;
+      if (!mask.empty()) mask += " | ";
+      mask += "(static_cast<ULong64_t>(static_cast<bool>(" + this->systematicFilter(sample, isyst, region) + ")) << " + std::to_string(ireg) + ")";
+    }
+    if (mask.empty()) mask = "ULong64_t(0)";
+
+    // events not passing any region are removed once per systematic
+    const std::string column = "regions_fastframes_" + isyst->name();
+    auto itr = defined.find(mask);
+    if (itr != defined.end()) {
+      m_columnIdentity[column] = this->regionMaskColumn(m_systematics.at(itr->second));
+      m_maskNodes.emplace_back(m_maskNodes.at(itr->second));
+      continue;
+    }
+    defined.emplace(mask, m_maskNodes.size());
+
+    m_plan.jitFormulas.emplace_back(mask);
+    m_plan.filters += 1;
+    m_maskNodes.emplace_back(this->jitDefine(node, column, mask)
+                               .Filter([](const ULong64_t regions) {return regions != 0;}, {column}));
+  }
+}
+
+std::string SampleGraph::regionMaskColumn(const std::shared_ptr<Systematic>& systematic) const {
+  return this->identicalColumn("regions_fastframes_" + systematic->name());
+}
+
+void SampleGraph::selectVectorisedVariables(ROOT::RDF::RNode node,
+                                            const std::shared_ptr<Sample>& sample) {
+
+  // values and weights of all systematics are evaluated for events passing the selection of any systematic,
+  // the standard booking evaluates them only behind the selection of their systematic.
+  // Defined columns (e.g. jet_pt_SYST[0]) may only be valid behind that selection
+  std::set<std::string> defined;
+  for (const auto& icolumn : node.GetDefinedColumnNames()) {
+    defined.emplace(icolumn);
+  }
+
+  // weight factors that differ between the systematics must only read input columns
+  std::map<std::string, std::size_t> factorCounts;
+  for (const auto& isyst : m_systematics) {
+    std::vector<std::string> terms = SampleGraph::weightFactors(this->replaceString(sample->weight(), isyst));
+    if (!isyst->weightSuffix().empty()) {
+      const std::vector<std::string> suffix = SampleGraph::weightFactors(isyst->weightSuffix());
+      terms.insert(terms.end(), suffix.begin(), suffix.end());
+    }
+    for (const auto& iterm : std::set<std::string>(terms.begin(), terms.end())) {
+      ++factorCounts[iterm];
+    }
+  }
+  for (const auto& [factor, count] : factorCounts) {
+    if (count == m_systematics.size()) continue;
+    if (factor.find('[') != std::string::npos || SampleGraph::readsColumn(factor, defined)) {
+      LOG(WARNING) << "Sample: " << sample->name() << ", weight factor: " << factor
+                   << " is not valid for all selections, vectorised systematics are not used\n";
+      return;
+    }
+  }
+
+  // the column types do not depend on the systematic, the nominal is not in every batch
+  const auto& systematic = m_systematics.front();
+  for (const auto& ireg : sample->regions()) {
+    for (const auto& variable : ireg->variables()) {
+      if (variable.isNominalOnly()) continue;
+      if (m_vectorisedVariables.find(variable.definition()) != m_vectorisedVariables.end()) continue;
+
+      // region specific columns are not known at this point
+      const std::string column = this->systematicVariable(variable, systematic);
+      if (!node.HasColumn(column)) continue;
+
+      const std::string type = node.GetColumnType(column);
+      if (type.find("vector") != std::string::npos || type.find("RVec") != std::string::npos) continue;
+
+      // a column shared by all systematics is evaluated behind the selection of each of them anyway
+      std::set<std::string> columns;
+      for (const auto& isyst : m_systematics) {
+        columns.emplace(this->systematicVariable(variable, isyst));
+      }
+      if (columns.size() > 1 && std::any_of(columns.begin(), columns.end(),
+                                             [&defined](const std::string& icolumn) {return defined.count(icolumn) > 0;})) {
+        LOG(DEBUG) << "Variable: " << variable.name() << " reads defined systematic columns, it is filled with the standard booking\n";
+        continue;
+      }
+
+      m_vectorisedVariables.emplace(variable.definition());
+    }
+  }
+
+  LOG(DEBUG) << "Sample: " << sample->name() << ", number of variables filled for all systematics at once: " << m_vectorisedVariables.size() << "\n";
+}
+
+ROOT::RDF::RNode SampleGraph::addVectorisedColumns(ROOT::RDF::RNode node,
+                                                   const std::shared_ptr<Sample>& sample) {
+
+  // "weights_fastframes" is defined with the weight columns
+  for (const auto& ireg : sample->regions()) {
+    for (const auto& variable : ireg->variables()) {
+      if (m_vectorisedVariables.find(variable.definition()) == m_vectorisedVariables.end()) continue;
+      if (m_packedValues.find(variable.definition()) != m_packedValues.end()) continue;
+
+      // systematics that do not affect the variable read the same column
+      std::map<std::string, std::size_t> distinct;
+      std::vector<std::string> valueColumns;
+      std::vector<std::vector<std::size_t> > positions;
+      for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+        const std::string systColumn = this->systematicVariable(variable, m_systematics.at(isyst));
+        const auto [itr, inserted] = distinct.emplace(systColumn, valueColumns.size());
+        if (inserted) {
+          valueColumns.emplace_back(systColumn);
+          positions.emplace_back();
+        }
+        positions.at(itr->second).emplace_back(isyst);
+      }
+
+      const std::string column = "values_fastframes_" + std::to_string(m_packedValues.size());
+      switch (this->columnType(node, variable, valueColumns.front())) {
+        ADD_PACKED_VALUES_SUPPORT(BOOL, bool)
+        ADD_PACKED_VALUES_SUPPORT(CHAR, char)
+        ADD_PACKED_VALUES_SUPPORT(INT, int)
+        ADD_PACKED_VALUES_SUPPORT(UNSIGNED_INT, unsigned int)
+        ADD_PACKED_VALUES_SUPPORT(LONG_INT, long long int)
+        ADD_PACKED_VALUES_SUPPORT(UNSIGNED, unsigned long)
+        ADD_PACKED_VALUES_SUPPORT(LONG_UNSIGNED, unsigned long long)
+        ADD_PACKED_VALUES_SUPPORT(FLOAT, float)
+        ADD_PACKED_VALUES_SUPPORT(DOUBLE, double)
+        default:
+          // filled with the standard booking
+          LOG(DEBUG) << "Variable: " << variable.name() << " has an unsupported type for vectorised systematics\n";
+          m_vectorisedVariables.erase(variable.definition());
+          continue;
+      }
+      m_packedValues.emplace(variable.definition(), column);
+    }
+  }
+
+  return node;
+}
+
+std::vector<VectorisedHisto> SampleGraph::bookVectorisedHistograms(const std::shared_ptr<Sample>& sample) {
+
+  std::vector<VectorisedHisto> result;
+  const std::vector<std::string>& sampleVariables = sample->variables();
+  const std::size_t nSystematics = m_systematics.size();
+
+  for (std::size_t ireg = 0; ireg < sample->regions().size(); ++ireg) {
+    const auto& region = sample->regions().at(ireg);
+    const std::string passedColumn = "passed_fastframes_" + region->name();
+
+    for (const auto& variable : region->variables()) {
+      auto itr = m_packedValues.find(variable.definition());
+      if (itr == m_packedValues.end()) continue;
+      if (!sampleVariables.empty() &&
+          std::find(sampleVariables.begin(), sampleVariables.end(), variable.name()) == sampleVariables.end()) continue;
+
+      VectorisedHisto histo;
+      histo.region = region;
+      histo.variableName = variable.name();
+      histo.result = m_regionNodes.at(ireg).Book<ROOT::VecOps::RVec<double>, ROOT::VecOps::RVec<double>, ROOT::VecOps::RVec<char> >(
+                       SystematicHistoAction(HistoAxis(variable), variable.title(), nSystematics),
+                       {itr->second, "weights_fastframes", passedColumn});
+      result.emplace_back(std::move(histo));
+    }
+  }
+
+  return result;
+}
+
+std::vector<SystematicHisto> SampleGraph::bookHistograms(RegionFilters& filters,
+                                                         std::vector<FlatHisto>& flatHistos,
+                                                         std::vector<MultiRegionHisto>& multiRegionHistos,
+                                                         std::vector<WeightVariationHisto>& weightVariationHistos,
+                                                         const std::shared_ptr<Sample>& sample) const {
+
+  std::vector<SystematicHisto> result;
+  const std::vector<std::string>& sampleVariables = sample->variables();
+
+  // histograms of systematics that change neither the selection nor the filled columns are booked once
+  BookedHistos booked;
+
+  // systematic index | region index | variable name, filled for all weight variations at once
+  std::set<std::tuple<std::size_t, std::size_t, std::string> > weightVariations;
+  if (m_bulkWeights) {
+    weightVariations = this->bookWeightVariationHistos(filters, sample, weightVariationHistos);
+  }
+
+  for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+    const auto& systematic = m_systematics.at(isyst);
+    SystematicHisto systematicHisto(systematic->name());
+
+    // region index | variable name, filled for all regions at once
+    std::set<std::pair<std::size_t, std::string> > multiRegion;
+    if (m_regionMask) {
+      multiRegion = this->bookMultiRegionHistos(sample, isyst, booked, multiRegionHistos);
+    }
+
+    for (std::size_t ireg = 0; ireg < sample->regions().size(); ++ireg) {
+      const auto& region = sample->regions().at(ireg);
+      if (sample->skipSystematicRegionCombination(systematic, region)) continue;
+
+      auto bookFlat = [&](const std::vector<std::string>& names, const std::string& identity) {
+        auto itr = booked.flat.find(identity);
+        if (itr != booked.flat.end()) {
+          FlatHisto histo;
+          histo.systematic = systematic;
+          histo.region = region;
+          histo.variableNames = names;
+          histo.result = itr->second;
+          flatHistos.emplace_back(std::move(histo));
+          return true;
+        }
+        if (!this->bookFlatHisto(filters.at(ireg).at(isyst).value(), region, names, systematic, flatHistos)) return false;
+        booked.flat.emplace(identity, flatHistos.back().result);
+        return true;
+      };
+
+      RegionHisto regionHisto(region->name());
+      for (const auto& variable : region->variables()) {
+        if (!systematic->isNominal() && variable.isNominalOnly()) continue;
+        if (m_vectorisedVariables.find(variable.definition()) != m_vectorisedVariables.end()) continue;
+        if (!sampleVariables.empty() &&
+            std::find(sampleVariables.begin(), sampleVariables.end(), variable.name()) == sampleVariables.end()) continue;
+        if (multiRegion.find(std::make_pair(ireg, variable.name())) != multiRegion.end()) continue;
+        if (weightVariations.find(std::make_tuple(isyst, ireg, variable.name())) != weightVariations.end()) continue;
+
+        const std::string identity = this->histoIdentity(sample, systematic, region,
+                                                         {this->systematicVariable(variable, systematic), this->systematicWeight(systematic)});
+        if (m_flat && bookFlat({variable.name()}, identity)) continue;
+
+        VariableHisto variableHisto(variable.name());
+        auto itr = booked.histos1D.find(identity);
+        if (itr == booked.histos1D.end()) {
+          itr = booked.histos1D.emplace(identity, this->book1Dhisto(filters.at(ireg).at(isyst).value(), variable, systematic)).first;
+        }
+        ROOT::RDF::RResultPtr<TH1D> histo = itr->second;
+        variableHisto.setHisto(histo);
+        regionHisto.addVariableHisto(std::move(variableHisto));
+      }
+
+      for (const auto& [name1, name2] : region->variableCombinations()) {
+        const Variable& v1 = region->variableByName(name1);
+        const Variable& v2 = region->variableByName(name2);
+        if (!systematic->isNominal() && (v1.isNominalOnly() || v2.isNominalOnly())) continue;
+
+        const std::string identity = this->histoIdentity(sample, systematic, region,
+                                                         {this->systematicVariable(v1, systematic),
+                                                          this->systematicVariable(v2, systematic),
+                                                          this->systematicWeight(systematic)});
+        if (m_flat && bookFlat({name1, name2}, identity)) continue;
+
+        VariableHisto2D variableHisto(name1 + "_vs_" + name2);
+        auto itr = booked.histos2D.find(identity);
+        if (itr == booked.histos2D.end()) {
+          m_plan.jitFormulas.emplace_back("Histo2D(" + this->systematicVariable(v1, systematic) + ", " + this->systematicVariable(v2, systematic) + ")");
+          itr = booked.histos2D.emplace(identity, filters.at(ireg).at(isyst)->Histo2D(Utils::histoModel2D(v1, v2),
+                                                                                    this->systematicVariable(v1, systematic),
+                                                                                    this->systematicVariable(v2, systematic),
+                                                                                    this->systematicWeight(systematic))).first;
+        }
+        ROOT::RDF::RResultPtr<TH2D> histo = itr->second;
+        variableHisto.setHisto(histo);
+        regionHisto.addVariableHisto2D(std::move(variableHisto));
+      }
+
+      for (const auto& [name1, name2, name3] : region->variableCombinations3D()) {
+        const Variable& v1 = region->variableByName(name1);
+        const Variable& v2 = region->variableByName(name2);
+        const Variable& v3 = region->variableByName(name3);
+        if (!systematic->isNominal() && (v1.isNominalOnly() || v2.isNominalOnly() || v3.isNominalOnly())) continue;
+
+        const std::string identity = this->histoIdentity(sample, systematic, region,
+                                                         {this->systematicVariable(v1, systematic),
+                                                          this->systematicVariable(v2, systematic),
+                                                          this->systematicVariable(v3, systematic),
+                                                          this->systematicWeight(systematic)});
+        if (m_flat && bookFlat({name1, name2, name3}, identity)) continue;
+
+        VariableHisto3D variableHisto(name1 + "_vs_" + name2 + "_vs_" + name3);
+        auto itr = booked.histos3D.find(identity);
+        if (itr == booked.histos3D.end()) {
+          m_plan.jitFormulas.emplace_back("Histo3D(" + this->systematicVariable(v1, systematic) + ", " + this->systematicVariable(v2, systematic) + ", " + this->systematicVariable(v3, systematic) + ")");
+          itr = booked.histos3D.emplace(identity, filters.at(ireg).at(isyst)->Histo3D(Utils::histoModel3D(v1, v2, v3),
+                                                                                    this->systematicVariable(v1, systematic),
+                                                                                    this->systematicVariable(v2, systematic),
+                                                                                    this->systematicVariable(v3, systematic),
+                                                                                    this->systematicWeight(systematic))).first;
+        }
+        ROOT::RDF::RResultPtr<TH3D> histo = itr->second;
+        variableHisto.setHisto(histo);
+        regionHisto.addVariableHisto3D(std::move(variableHisto));
+      }
+
+      systematicHisto.addRegionHisto(std::move(regionHisto));
+    }
+    result.emplace_back(std::move(systematicHisto));
+  }
+
+  m_plan.actions += booked.histos1D.size() + booked.histos2D.size() + booked.histos3D.size() +
+                    booked.flat.size() + booked.multiRegion.size();
+
+  return result;
+}
+
+std::set<std::pair<std::size_t, std::string> > SampleGraph::bookMultiRegionHistos(const std::shared_ptr<Sample>& sample,
+                                                                                 const std::size_t isyst,
+                                                                                 BookedHistos& booked,
+                                                                                 std::vector<MultiRegionHisto>& multiRegionHistos) const {
+
+  std::set<std::pair<std::size_t, std::string> > result;
+  const auto& systematic = m_systematics.at(isyst);
+  const std::vector<std::string>& sampleVariables = sample->variables();
+  ROOT::RDF::RNode node = m_maskNodes.at(isyst);
+
+  // variable name | regions where it is filled
+  std::map<std::string, std::vector<std::size_t> > regionsOfVariable;
+  for (std::size_t ireg = 0; ireg < sample->regions().size(); ++ireg) {
+    const auto& region = sample->regions().at(ireg);
+    if (sample->skipSystematicRegionCombination(systematic, region)) continue;
+    for (const auto& variable : region->variables()) {
+      if (!systematic->isNominal() && variable.isNominalOnly()) continue;
+      if (!sampleVariables.empty() &&
+          std::find(sampleVariables.begin(), sampleVariables.end(), variable.name()) == sampleVariables.end()) continue;
+      regionsOfVariable[variable.name()].emplace_back(ireg);
+    }
+  }
+
+  for (const auto& [name, regions] : regionsOfVariable) {
+    if (regions.size() < 2) continue;
+
+    const Variable& variable = sample->regions().at(regions.front())->variableByName(name);
+    const bool sameDefinition = std::all_of(regions.begin(), regions.end(), [&sample, &name, &variable](const std::size_t ireg) {
+      return sample->regions().at(ireg)->variableByName(name).definition() == variable.definition();
+    });
+    if (!sameDefinition) continue;
+
+    // region specific columns are not available before the region filters
+    const std::string column = this->systematicVariable(variable, systematic);
+    if (!node.HasColumn(column)) continue;
+
+    std::vector<HistoAxis> axes;
+    std::vector<std::size_t> bits;
+    std::vector<std::shared_ptr<Region> > regionPointers;
+    std::string identity;
+    for (const std::size_t ireg : regions) {
+      axes.emplace_back(sample->regions().at(ireg)->variableByName(name));
+      bits.emplace_back(ireg);
+      regionPointers.emplace_back(sample->regions().at(ireg));
+      identity += this->histoIdentity(sample, systematic, regionPointers.back(), {column, this->systematicWeight(systematic)}) + "\n";
+    }
+
+    MultiRegionHisto histo;
+    histo.systematic = systematic;
+    histo.regions = std::move(regionPointers);
+    histo.variableName = name;
+
+    auto itr = booked.multiRegion.find(identity);
+    if (itr != booked.multiRegion.end()) {
+      histo.result = itr->second;
+      multiRegionHistos.emplace_back(std::move(histo));
+      for (const std::size_t ireg : regions) {
+        result.emplace(ireg, name);
+      }
+      continue;
+    }
+
+    const std::vector<std::string> columns = {column, this->systematicWeight(systematic), this->regionMaskColumn(systematic)};
+    ROOT::RDF::RResultPtr<MultiRegionHistoResult> bookedResult;
+    switch (this->columnType(node, variable, column)) {
+      ADD_MULTI_REGION_HISTO_SUPPORT_SCALAR(BOOL, bool)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(CHAR, char)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(INT, int)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(UNSIGNED_INT, unsigned int)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(LONG_INT, long long int)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(UNSIGNED, unsigned long)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(LONG_UNSIGNED, unsigned long long)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(FLOAT, float)
+      ADD_MULTI_REGION_HISTO_SUPPORT_VECTOR(DOUBLE, double)
+      default:
+        continue;
+    }
+
+    histo.result = bookedResult;
+    booked.multiRegion.emplace(identity, bookedResult);
+    multiRegionHistos.emplace_back(std::move(histo));
+
+    for (const std::size_t ireg : regions) {
+      result.emplace(ireg, name);
+    }
+  }
+
+  return result;
+}
+
+bool SampleGraph::bookFlatHisto(ROOT::RDF::RNode& node,
+                                const std::shared_ptr<Region>& region,
+                                const std::vector<std::string>& variableNames,
+                                const std::shared_ptr<Systematic>& systematic,
+                                std::vector<FlatHisto>& flatHistos) const {
+
+  std::vector<HistoAxis> axes;
+  std::vector<std::string> columns;
+  for (const auto& iname : variableNames) {
+    const Variable& variable = region->variableByName(iname);
+    axes.emplace_back(variable);
+    columns.emplace_back(this->systematicVariable(variable, systematic));
+  }
+
+  // post-fill normalisation: fill the weight formula, the histogram of each UniqueSampleID is scaled at the end
+  std::string weight = this->systematicWeight(systematic);
+  std::vector<double> normalisations;
+  if (m_postFillNormalisation) {
+    const auto& [formulaColumn, sampleNormalisations] = m_unnormalisedWeights.at(systematic->name());
+    weight = formulaColumn;
+    normalisations = sampleNormalisations;
+  }
+
+  ROOT::RDF::RResultPtr<FlatHistoResult> result;
+  if (variableNames.size() == 1) {
+    const Variable& variable = region->variableByName(variableNames.front());
+    const VariableType type = this->columnType(node, variable, columns.front());
+    columns.emplace_back(weight);
+    if (m_postFillNormalisation) columns.emplace_back("sample_index_fastframes");
+    switch (type) {
+      ADD_FLAT_HISTO_1D_SUPPORT_SCALAR(BOOL, bool)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(CHAR, char)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(INT, int)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(UNSIGNED_INT, unsigned int)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(LONG_INT, long long int)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(UNSIGNED, unsigned long)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(LONG_UNSIGNED, unsigned long long)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(FLOAT, float)
+      ADD_FLAT_HISTO_1D_SUPPORT_VECTOR(DOUBLE, double)
+      default:
+        return false;
+    }
+  } else {
+    // 2D and 3D: convert the columns to avoid compiling all type combinations
+    std::vector<bool> scalars;
+    std::vector<std::string> flatColumns;
+    for (const auto& iname : variableNames) {
+      bool scalar(false);
+      if (!this->addFlatColumn(node, region->variableByName(iname), systematic, scalar)) return false;
+      scalars.emplace_back(scalar);
+      flatColumns.emplace_back("flat_fastframes_" + this->systematicVariable(region->variableByName(iname), systematic));
+    }
+    flatColumns.emplace_back(weight);
+    if (m_postFillNormalisation) flatColumns.emplace_back("sample_index_fastframes");
+    result = bookFlatConverted(node, axes, flatColumns, scalars, normalisations, m_unnormalisedHistos);
+  }
+
+  FlatHisto histo;
+  histo.systematic = systematic;
+  histo.region = region;
+  histo.variableNames = variableNames;
+  histo.result = result;
+  flatHistos.emplace_back(std::move(histo));
+
+  return true;
+}
+
+bool SampleGraph::addFlatColumn(ROOT::RDF::RNode& node,
+                                const Variable& variable,
+                                const std::shared_ptr<Systematic>& systematic,
+                                bool& scalar) const {
+
+  const std::string column = this->systematicVariable(variable, systematic);
+  const std::string flatColumn = "flat_fastframes_" + column;
+  if (node.HasColumn(flatColumn)) {
+    scalar = node.GetColumnType(flatColumn) == "double";
+    return true;
+  }
+
+  switch (this->columnType(node, variable, column)) {
+    ADD_FLAT_COLUMN_SUPPORT_SCALAR(BOOL, bool)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(CHAR, char)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(INT, int)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(UNSIGNED_INT, unsigned int)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(LONG_INT, long long int)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(UNSIGNED, unsigned long)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(LONG_UNSIGNED, unsigned long long)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(FLOAT, float)
+    ADD_FLAT_COLUMN_SUPPORT_VECTOR(DOUBLE, double)
+    default:
+      return false;
+  }
+}
+
+VariableType SampleGraph::columnType(ROOT::RDF::RNode node,
+                                     const Variable& variable,
+                                     const std::string& column) const {
+
+  if (variable.type() != VariableType::UNDEFINED) return variable.type();
+
+  return typeFromName(node.GetColumnType(column));
+}
+
+ROOT::RDF::RResultPtr<TH1D> SampleGraph::book1Dhisto(ROOT::RDF::RNode node,
+                                                     const Variable& variable,
+                                                     const std::shared_ptr<Systematic>& systematic) const {
+
+  switch (variable.type()) {
+    ADD_HISTO_1D_SUPPORT_SCALAR(BOOL, bool)
+    ADD_HISTO_1D_SUPPORT_VECTOR(CHAR, char)
+    ADD_HISTO_1D_SUPPORT_VECTOR(INT, int)
+    ADD_HISTO_1D_SUPPORT_VECTOR(UNSIGNED_INT, unsigned int)
+    ADD_HISTO_1D_SUPPORT_VECTOR(LONG_INT, long long int)
+    ADD_HISTO_1D_SUPPORT_VECTOR(UNSIGNED, unsigned long)
+    ADD_HISTO_1D_SUPPORT_VECTOR(LONG_UNSIGNED, unsigned long long)
+    ADD_HISTO_1D_SUPPORT_VECTOR(FLOAT, float)
+    ADD_HISTO_1D_SUPPORT_VECTOR(DOUBLE, double)
+    default:
+      m_plan.jitFormulas.emplace_back("Histo1D(" + this->systematicVariable(variable, systematic) + ")");
+      return node.Histo1D(variable.histoModel1D(),
+                          this->systematicVariable(variable, systematic),
+                          this->systematicWeight(systematic));
+  }
+}
+
+void SampleGraph::writeHistosToFile(const std::vector<SystematicHisto>& histos,
+                                    const std::vector<FlatHisto>& flatHistos,
+                                    const std::vector<MultiRegionHisto>& multiRegionHistos,
+                                    const std::vector<VectorisedHisto>& vectorisedHistos,
+                                    const std::vector<WeightVariationHisto>& weightVariationHistos,
+                                    const std::shared_ptr<Sample>& sample,
+                                    const bool recreate) const {
+
+  const std::string fileName = this->outputFileName(sample);
+  std::unique_ptr<TFile> out(TFile::Open(fileName.c_str(), recreate ? "RECREATE" : "UPDATE"));
+  if (!out || out->IsZombie()) {
+    LOG(ERROR) << "Cannot open file: " << fileName << "\n";
+    throw std::invalid_argument("");
+  }
+
+  // members of the aggregated groups whose histograms are not filled by the bulk action are written per variation
+  std::set<std::string> aggregated;
+  for (const auto& isyst : m_systematics) {
+    if (!this->aggregationGroup(isyst).empty()) aggregated.emplace(isyst->name());
+  }
+  std::size_t notAggregated(0);
+
+  const bool regionFolders = m_config->useRegionSubfolders();
+  for (const auto& isystHist : histos) {
+    for (const auto& iregionHist : isystHist.regionHistos()) {
+      if (aggregated.find(isystHist.name()) != aggregated.end()) {
+        notAggregated += iregionHist.variableHistos().size() + iregionHist.variableHistos2D().size() + iregionHist.variableHistos3D().size();
+      }
+      const std::string folder = regionFolders ? isystHist.name() + "/" + iregionHist.name() : isystHist.name();
+      TDirectory* dir = out->mkdir(folder.c_str(), "", true);
+      dir->cd();
+
+      auto histoName = [&iregionHist, regionFolders](const std::string& name) {
+        return regionFolders ? name : name + "_" + iregionHist.name();
+      };
+
+      for (const auto& ivariableHist : iregionHist.variableHistos()) {
+        ivariableHist.histo()->Write(histoName(ivariableHist.name()).c_str());
+      }
+      for (const auto& ivariableHist : iregionHist.variableHistos2D()) {
+        ivariableHist.histo()->Write(histoName(ivariableHist.name()).c_str());
+      }
+      for (const auto& ivariableHist : iregionHist.variableHistos3D()) {
+        ivariableHist.histo()->Write(histoName(ivariableHist.name()).c_str());
+      }
+    }
+  }
+
+  // the histograms are only created here, from the same models as Histo1D/2D/3D would use
+  for (const auto& ihisto : flatHistos) {
+    if (aggregated.find(ihisto.systematic->name()) != aggregated.end()) ++notAggregated;
+    const std::string& regionName = ihisto.region->name();
+    const std::string folder = regionFolders ? ihisto.systematic->name() + "/" + regionName : ihisto.systematic->name();
+    std::string name = ihisto.variableNames.front();
+    for (std::size_t i = 1; i < ihisto.variableNames.size(); ++i) {
+      name += "_vs_" + ihisto.variableNames.at(i);
+    }
+    if (!regionFolders) name += "_" + regionName;
+
+    std::vector<const Variable*> variables;
+    for (const auto& iname : ihisto.variableNames) {
+      variables.emplace_back(&ihisto.region->variableByName(iname));
+    }
+
+    auto makeHisto = [&variables]() -> std::shared_ptr<TH1> {
+      if (variables.size() == 1) return variables.at(0)->histoModel1D().GetHistogram();
+      if (variables.size() == 2) return Utils::histoModel2D(*variables.at(0), *variables.at(1)).GetHistogram();
+      return Utils::histoModel3D(*variables.at(0), *variables.at(1), *variables.at(2)).GetHistogram();
+    };
+
+    ROOT::RDF::RResultPtr<FlatHistoResult> result = ihisto.result;
+    std::shared_ptr<TH1> histo = makeHisto();
+    result->fill(histo.get());
+    out->mkdir(folder.c_str(), "", true)->cd();
+    histo->Write(name.c_str());
+
+    // re-normalisation cache: the content of each UniqueSampleID without luminosity * cross-section/sum of weights
+    const std::vector<UniqueSampleID>& ids = sample->uniqueSampleIDs();
+    for (std::size_t isample = 0; isample < result->nSamples(); ++isample) {
+      const FlatHistoResult* unnormalised = result->sample(isample);
+      if (!unnormalised) continue;
+      const UniqueSampleID& id = ids.at(isample);
+      const std::string idFolder = "unnormalised/" + std::to_string(id.dsid()) + "_" + id.campaign() + "_" + id.simulation() + "/" + folder;
+      std::shared_ptr<TH1> idHisto = makeHisto();
+      unnormalised->fill(idHisto.get());
+      out->mkdir(idFolder.c_str(), "", true)->cd();
+      idHisto->Write(name.c_str());
+    }
+  }
+
+  for (const auto& ihisto : multiRegionHistos) {
+    ROOT::RDF::RResultPtr<MultiRegionHistoResult> result = ihisto.result;
+    for (std::size_t ireg = 0; ireg < ihisto.regions.size(); ++ireg) {
+      const std::string& regionName = ihisto.regions.at(ireg)->name();
+      const std::string folder = regionFolders ? ihisto.systematic->name() + "/" + regionName : ihisto.systematic->name();
+      const std::string name = regionFolders ? ihisto.variableName : ihisto.variableName + "_" + regionName;
+
+      std::shared_ptr<TH1D> histo = ihisto.regions.at(ireg)->variableByName(ihisto.variableName).histoModel1D().GetHistogram();
+      result->region(ireg).fill(histo.get());
+      out->mkdir(folder.c_str(), "", true)->cd();
+      histo->Write(name.c_str());
+    }
+  }
+
+  for (std::size_t isyst = 0; isyst < m_systematics.size(); ++isyst) {
+    const auto& systematic = m_systematics.at(isyst);
+    for (const auto& ihisto : vectorisedHistos) {
+      if (sample->skipSystematicRegionCombination(systematic, ihisto.region)) continue;
+
+      const std::string& regionName = ihisto.region->name();
+      const std::string folder = regionFolders ? systematic->name() + "/" + regionName : systematic->name();
+      const std::string name = regionFolders ? ihisto.variableName : ihisto.variableName + "_" + regionName;
+      out->mkdir(folder.c_str(), "", true)->cd();
+      ROOT::RDF::RResultPtr<SystematicHistoResult> result = ihisto.result;
+      std::unique_ptr<TH1D> histo = result->histo(isyst, name);
+      histo->Write(name.c_str());
+    }
+  }
+
+  static const std::array<std::string, 4> aggregateSuffixes = {"_envelope_up", "_envelope_down", "_rms_up", "_rms_down"};
+  std::set<std::tuple<std::string, std::string, std::string> > writtenAggregates;
+  for (const auto& ihisto : weightVariationHistos) {
+    const std::string& regionName = ihisto.region->name();
+    const std::string name = regionFolders ? ihisto.variableName : ihisto.variableName + "_" + regionName;
+    ROOT::RDF::RResultPtr<SystematicHistoResult> result = ihisto.result;
+
+    // group | variations, only the aggregates of the groups are written
+    std::map<std::string, std::vector<std::size_t> > groups;
+    for (std::size_t i = 0; i < ihisto.systematics.size(); ++i) {
+      const std::string group = this->aggregationGroup(ihisto.systematics.at(i));
+      if (!group.empty()) {
+        groups[group].emplace_back(ihisto.variations.at(i));
+        continue;
+      }
+      const std::string folder = regionFolders ? ihisto.systematics.at(i)->name() + "/" + regionName : ihisto.systematics.at(i)->name();
+      out->mkdir(folder.c_str(), "", true)->cd();
+      std::unique_ptr<TH1D> histo = result->histo(ihisto.variations.at(i), name);
+      histo->Write(name.c_str());
+    }
+
+    for (auto& [group, variations] : groups) {
+      if (!writtenAggregates.emplace(group, regionName, name).second) {
+        LOG(WARNING) << "Sample: " << sample->name() << ", the variations of group: " << group << " for histogram: " << name
+                     << " in region: " << regionName << " are filled by several bulk actions (they change the selection or the variable), "
+                     << "only the aggregates of the last action are kept\n";
+      }
+      // members with identical weights share a variation, its index is kept once per member
+      std::array<std::unique_ptr<TH1D>, 4> aggregates = result->aggregates(variations, name);
+      for (std::size_t i = 0; i < aggregates.size(); ++i) {
+        const std::string systematicName = group + aggregateSuffixes.at(i);
+        const std::string folder = regionFolders ? systematicName + "/" + regionName : systematicName;
+        out->mkdir(folder.c_str(), "", true)->cd();
+        aggregates.at(i)->Write(name.c_str());
+      }
+    }
+  }
+
+  out->Close();
+  LOG(INFO) << "Written histograms for sample: " << sample->name() << " to: " << fileName << "\n";
+
+  if (notAggregated > 0) {
+    LOG(WARNING) << "Sample: " << sample->name() << ", " << notAggregated << " histograms of systematics in aggregated_weight_variations "
+                 << "are not filled by the bulk action (2D/3D histograms, unsupported column types or systematics changing the selection "
+                 << "or the variable), they are written per variation and are not part of the aggregates\n";
+  }
+}
+
+std::string SampleGraph::aggregationGroup(const std::shared_ptr<Systematic>& systematic) const {
+  if (systematic->isNominal()) return "";
+
+  return SampleGraph::aggregationGroup(systematic->name(), m_aggregatedGroups);
+}
+
+std::vector<std::pair<std::string, std::regex> > SampleGraph::aggregationGroups(const std::string& option) {
+  std::vector<std::pair<std::string, std::regex> > result;
+  for (const auto& igroup : StringOperations::splitAndStripString(option, ",")) {
+    const std::size_t pos = igroup.find(':');
+    if (pos == 0 || pos == std::string::npos || pos + 1 == igroup.size()) {
+      LOG(ERROR) << "Group: " << igroup << " of aggregated_weight_variations is not of the form <group>:<regex>\n";
+      throw std::invalid_argument("");
+    }
+    try {
+      result.emplace_back(igroup.substr(0, pos), std::regex(igroup.substr(pos + 1)));
+    } catch (const std::regex_error& e) {
+      LOG(ERROR) << "Group: " << igroup << " of aggregated_weight_variations has an invalid regex: " << e.what() << "\n";
+      throw std::invalid_argument("");
+    }
+  }
+
+  return result;
+}
+
+std::string SampleGraph::aggregationGroup(const std::string& systematic,
+                                          const std::vector<std::pair<std::string, std::regex> >& groups) {
+  for (const auto& [group, regex] : groups) {
+    if (std::regex_match(systematic, regex)) return group;
+  }
+
+  return "";
+}
+
+std::string SampleGraph::systematicFilter(const std::shared_ptr<Sample>& sample,
+                                          const std::shared_ptr<Systematic>& systematic,
+                                          const std::shared_ptr<Region>& region) const {
+
+  std::string selection = region->selection();
+  if (!sample->selectionSuffix().empty()) {
+    selection = "(" + selection + ") && (" + sample->selectionSuffix() + ")";
+  }
+
+  return this->replaceString(selection, systematic);
+}
+
+std::string SampleGraph::systematicVariable(const Variable& variable,
+                                            const std::shared_ptr<Systematic>& systematic) const {
+
+  auto itr = m_variablesWithFormula.find(variable.definition());
+  const std::string& definition = itr == m_variablesWithFormula.end() ? variable.definition() : itr->second;
+
+  return this->replaceString(definition, systematic);
+}
+
+std::string SampleGraph::systematicWeight(const std::shared_ptr<Systematic>& systematic) const {
+  return this->identicalColumn("weight_total_" + systematic->name());
+}
+
+std::string SampleGraph::replaceString(const std::string& original,
+                                       const std::shared_ptr<Systematic>& systematic) const {
+
+  if (!m_systIndex) return m_systReplacer.replaceString(original, systematic);
+
+  return m_systIndex->replaceString(original, systematic);
+}
+
+std::string SampleGraph::identicalColumn(const std::string& column) const {
+  auto itr = m_columnIdentity.find(column);
+  if (itr == m_columnIdentity.end()) return column;
+
+  return itr->second;
+}
+
+std::string SampleGraph::histoIdentity(const std::shared_ptr<Sample>& sample,
+                                       const std::shared_ptr<Systematic>& systematic,
+                                       const std::shared_ptr<Region>& region,
+                                       const std::vector<std::string>& columns) const {
+
+  // the content only depends on the selected events and on the columns filled
+  std::string result = region->name() + "\n" + this->systematicFilter(sample, systematic, region);
+  for (const auto& icolumn : columns) {
+    result += "\n" + icolumn;
+  }
+
+  return result;
+}
+
+std::string SampleGraph::outputFileName(const std::shared_ptr<Sample>& sample) const {
+
+  std::string name = sample->name();
+  if (m_config->totalJobSplits() > 0) {
+    name += "_Chunk" + std::to_string(m_config->currentJobIndex());
+  }
+  name += ".root";
+
+  return (std::filesystem::path(m_config->outputPathHistograms()) / name).string();
+}
@@ -0,0 +1,195 @@
+#include "TutorialClass/SumWeightsTable.h"
+#include "TutorialClass/Hash.h"
+
+#include "FastFrames/Logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace {
+  const char magic[] = "FFSUMW02";
+  constexpr std::size_t magicSize = 8;
+  constexpr std::size_t fingerprintSize = 3*sizeof(std::uint64_t);
+  constexpr std::size_t headerSize = magicSize + fingerprintSize + sizeof(std::uint64_t);
+
+  /**
+   * @brief Key prefix of all variations of a UniqueSampleID
+   *
+   * @param id
+   * @return std::string
+   */
+  std::string idPrefix(const UniqueSampleID& id) {
+    std::ostringstream result;
+    result << id << " ";
+    return result.str();
+  }
+}
+
+SumWeightsTable::SumWeightsTable(const std::string& path) :
+  m_file(path),
+  m_source{0, 0, 0},
+  m_entries(nullptr),
+  m_nEntries(0),
+  m_keys(nullptr),
+  m_keysSize(0)
+{
+  const char* bytes = m_file.data();
+  if (m_file.size() >= headerSize) {
+    std::memcpy(&m_source.size, bytes + magicSize, sizeof(m_source.size));
+    std::memcpy(&m_source.time, bytes + magicSize + sizeof(std::uint64_t), sizeof(m_source.time));
+    std::memcpy(&m_source.hash, bytes + magicSize + 2*sizeof(std::uint64_t), sizeof(m_source.hash));
+    std::memcpy(&m_nEntries, bytes + magicSize + fingerprintSize, sizeof(m_nEntries));
+  }
+  if (m_file.size() < headerSize || std::memcmp(bytes, magic, magicSize) != 0 || m_nEntries > (m_file.size() - headerSize)/sizeof(Entry)) {
+    LOG(ERROR) << "File: " << path << " is not a sum of weights table (tables of older versions have to be produced again)\n";
+    throw std::invalid_argument("");
+  }
+
+  m_entries = reinterpret_cast<const Entry*>(bytes + headerSize);
+  m_keys = bytes + headerSize + m_nEntries*sizeof(Entry);
+  m_keysSize = m_file.size() - headerSize - m_nEntries*sizeof(Entry);
+}
+
+bool SumWeightsTable::matches(const std::string& textPath) const {
+  const Fingerprint current = SumWeightsTable::fingerprint(textPath, false);
+  if (current.size != m_source.size) return false;
+  if (current.time == m_source.time) return true;
+
+  return SumWeightsTable::fingerprint(textPath, true).hash == m_source.hash;
+}
+
+std::vector<std::pair<std::string, double> > SumWeightsTable::sumWeights(const UniqueSampleID& id) const {
+
+  std::vector<std::pair<std::string, double> > result;
+  const std::string prefix = idPrefix(id);
+
+  // the keys are sorted, all variations of the UniqueSampleID follow each other
+  const Entry* end = m_entries + m_nEntries;
+  const Entry* itr = std::lower_bound(m_entries, end, prefix, [this](const Entry& entry, const std::string& value) {
+    return this->key(entry) < value;
+  });
+
+  for (; itr != end; ++itr) {
+    const std::string_view entryKey = this->key(*itr);
+    if (entryKey.compare(0, prefix.size(), prefix) != 0) break;
+    result.emplace_back(std::string(entryKey.substr(prefix.size())), itr->value);
+  }
+
+  return result;
+}
+
+void SumWeightsTable::write(const std::string& path, const Entries& entries, const std::string& textPath) {
+
+  std::vector<std::pair<std::string, double> > sorted;
+  for (const auto& [id, variations] : entries) {
+    const std::string prefix = idPrefix(id);
+    for (const auto& [variation, value] : variations) {
+      sorted.emplace_back(prefix + variation, value);
+    }
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  std::vector<Entry> table;
+  std::string keys;
+  for (const auto& [key, value] : sorted) {
+    Entry entry;
+    entry.keyOffset = keys.size();
+    entry.keyLength = key.size();
+    entry.padding = 0;
+    entry.value = value;
+    table.emplace_back(entry);
+    keys += key;
+  }
+
+  const Fingerprint source = SumWeightsTable::fingerprint(textPath, true);
+
+  // written next to the target and renamed, jobs may read the table in the meantime
+  const std::string temporary = path + ".tmp" + std::to_string(::getpid());
+  {
+    std::ofstream out(temporary, std::ios::binary);
+    const std::uint64_t nEntries = table.size();
+    out.write(magic, magicSize);
+    out.write(reinterpret_cast<const char*>(&source.size), sizeof(source.size));
+    out.write(reinterpret_cast<const char*>(&source.time), sizeof(source.time));
+    out.write(reinterpret_cast<const char*>(&source.hash), sizeof(source.hash));
+    out.write(reinterpret_cast<const char*>(&nEntries), sizeof(nEntries));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size()*sizeof(Entry));
+    out.write(keys.data(), keys.size());
+    if (!out.good()) {
+      LOG(ERROR) << "Cannot write file: " << temporary << "\n";
+      throw std::invalid_argument("");
+    }
+  }
+  std::filesystem::rename(temporary, path);
+
+  LOG(INFO) << "Written " << table.size() << " sums of weights to: " << path << "\n";
+}
+
+SumWeightsTable::Entries SumWeightsTable::readText(const std::string& path) {
+
+  std::ifstream in(path);
+  if (!in.good()) {
+    LOG(ERROR) << "Cannot open file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+
+  Entries result;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line.front() == '#') continue;
+
+    std::istringstream stream(line);
+    int dsid;
+    std::string campaign;
+    std::string simulation;
+    std::string variation;
+    double value;
+    if (!(stream >> dsid >> campaign >> simulation >> variation >> value)) {
+      LOG(WARNING) << "Cannot parse line: \"" << line << "\" in file: " << path << ", skipping\n";
+      continue;
+    }
+    result[UniqueSampleID(dsid, campaign, simulation)][variation] = value;
+  }
+
+  return result;
+}
+
+std::string SumWeightsTable::tablePath(const std::string& textPath) {
+  return std::filesystem::path(textPath).replace_extension(".bin").string();
+}
+
+SumWeightsTable::Fingerprint SumWeightsTable::fingerprint(const std::string& path, const bool withHash) {
+
+  Fingerprint result{0, 0, 0};
+  std::error_code error;
+  result.size = std::filesystem::file_size(path, error);
+  if (error) {
+    LOG(ERROR) << "Cannot read the size of file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+  result.time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+  if (!withHash) return result;
+
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream content;
+  content << in.rdbuf();
+  result.hash = Hash::fnv1a(content.str());
+
+  return result;
+}
+
+std::string_view SumWeightsTable::key(const Entry& entry) const {
+  if (entry.keyOffset > m_keysSize || entry.keyLength > m_keysSize - entry.keyOffset) {
+    LOG(ERROR) << "Corrupted sum of weights table, key at: " << entry.keyOffset << " with length: " << entry.keyLength
+               << " is outside of the " << m_keysSize << " bytes of the keys\n";
+    throw std::runtime_error("");
+  }
+
+  return std::string_view(m_keys + entry.keyOffset, entry.keyLength);
+}
@@ -0,0 +1,109 @@
+#include "TutorialClass/SystematicBranchMatcher.h"
+#include "TutorialClass/Hash.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+SystematicBranchMatcher::SystematicBranchMatcher(const std::vector<std::string>& systematics) :
+  m_nodes(1)
+{
+  for (const auto& isystematic : systematics) {
+    if (isystematic == "NOSYS" || isystematic.empty()) continue;
+
+    std::size_t node(0);
+    for (const char c : isystematic) {
+      std::size_t next = this->child(node, c);
+      if (next == 0) {
+        next = m_nodes.size();
+        m_nodes.emplace_back();
+        auto& children = m_nodes.at(node).children;
+        children.insert(std::upper_bound(children.begin(), children.end(), std::make_pair(c, std::size_t(0))), std::make_pair(c, next));
+      }
+      node = next;
+    }
+    if (m_nodes.at(node).systematic >= 0) continue;
+    m_nodes.at(node).systematic = m_systematics.size();
+    m_systematics.emplace_back(isystematic);
+  }
+}
+
+std::vector<SystematicBranchMatcher::Variation> SystematicBranchMatcher::variations(const std::vector<std::string>& branches) const {
+
+  std::vector<Variation> result;
+  std::unordered_map<std::string, std::size_t> positions;
+  for (std::size_t ibranch = 0; ibranch < branches.size(); ++ibranch) {
+    positions.emplace(branches.at(ibranch), ibranch);
+  }
+
+  for (std::size_t ibranch = 0; ibranch < branches.size(); ++ibranch) {
+    const std::string& branch = branches.at(ibranch);
+    for (std::size_t begin = 0; begin < branch.size(); ++begin) {
+      if (begin > 0 && branch.at(begin - 1) != '_') continue;
+
+      // all systematic names starting at this position
+      std::size_t node(0);
+      for (std::size_t end = begin; end < branch.size(); ++end) {
+        node = this->child(node, branch.at(end));
+        if (node == 0) break;
+
+        const long long int systematic = m_nodes.at(node).systematic;
+        if (systematic < 0) continue;
+        if (end + 1 < branch.size() && branch.at(end + 1) != '_') continue;
+
+        auto itr = positions.find(branch.substr(0, begin) + "NOSYS" + branch.substr(end + 1));
+        if (itr == positions.end()) continue;
+
+        Variation variation;
+        variation.branch = ibranch;
+        variation.nominal = itr->second;
+        variation.systematic = systematic;
+        result.emplace_back(variation);
+      }
+    }
+  }
+
+  return result;
+}
+
+std::vector<std::string> SystematicBranchMatcher::affectedBranches(const std::vector<std::string>& branches) const {
+
+  std::vector<bool> keep(branches.size(), false);
+  for (const auto& ivariation : this->variations(branches)) {
+    keep.at(ivariation.branch) = true;
+    keep.at(ivariation.nominal) = true;
+  }
+
+  std::vector<std::string> result;
+  for (std::size_t ibranch = 0; ibranch < branches.size(); ++ibranch) {
+    if (keep.at(ibranch)) result.emplace_back(branches.at(ibranch));
+  }
+
+  return result;
+}
+
+std::uint64_t SystematicBranchMatcher::schemaHash(const std::vector<std::string>& branches) const {
+
+  std::uint64_t result = Hash::fnv1aOffset;
+  auto add = [&result](const std::string& text) {
+    // 0xff cannot appear in the names, separates them
+    result = Hash::fnv1a(text + '\xff', result);
+  };
+
+  for (const auto& ibranch : branches) {
+    add(ibranch);
+  }
+  add("|");
+  for (const auto& isystematic : m_systematics) {
+    add(isystematic);
+  }
+
+  return result;
+}
+
+std::size_t SystematicBranchMatcher::child(const std::size_t node, const char c) const {
+  const auto& children = m_nodes.at(node).children;
+  auto itr = std::lower_bound(children.begin(), children.end(), std::make_pair(c, std::size_t(0)));
+  if (itr == children.end() || itr->first != c) return 0;
+
+  return itr->second;
+}
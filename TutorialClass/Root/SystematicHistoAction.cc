@@ -0,0 +1,155 @@
+#include "TutorialClass/SystematicHistoAction.h"
+
+#include "TROOT.h"
+
+#include <algorithm>
+#include <cmath>
+
+SystematicHistoResult::SystematicHistoResult(const HistoAxis& axis, const std::string& title, const std::size_t nSystematics) :
+  m_axis(axis),
+  m_title(title),
+  m_nSystematics(nSystematics),
+  m_sumW(nSystematics*axis.nbinsWithFlows(), 0.),
+  m_sumW2(nSystematics*axis.nbinsWithFlows(), 0.),
+  m_stats(nSystematics*nStats, 0.),
+  m_entries(nSystematics, 0.)
+{
+}
+
+void SystematicHistoResult::add(const std::vector<double>& sumW,
+                                const std::vector<double>& sumW2,
+                                const std::vector<double>& stats,
+                                const std::vector<double>& entries) {
+  for (std::size_t i = 0; i < m_sumW.size(); ++i) {
+    m_sumW[i]  += sumW[i];
+    m_sumW2[i] += sumW2[i];
+  }
+  for (std::size_t i = 0; i < m_stats.size(); ++i) {
+    m_stats[i] += stats[i];
+  }
+  for (std::size_t i = 0; i < m_entries.size(); ++i) {
+    m_entries[i] += entries[i];
+  }
+}
+
+std::unique_ptr<TH1D> SystematicHistoResult::histo(const std::size_t systematic, const std::string& name) const {
+  std::unique_ptr<TH1D> result = m_axis.emptyHisto(name, m_title);
+
+  const std::size_t nbins = m_axis.nbinsWithFlows();
+  const std::size_t offset = systematic*nbins;
+  for (std::size_t ibin = 0; ibin < nbins; ++ibin) {
+    result->SetBinContent(ibin, m_sumW.at(offset + ibin));
+    result->SetBinError(ibin, std::sqrt(m_sumW2.at(offset + ibin)));
+  }
+
+  // SetBinContent resets the statistics, they are set afterwards
+  std::array<double, nStats> stats;
+  std::copy_n(m_stats.begin() + systematic*nStats, nStats, stats.begin());
+  result->PutStats(stats.data());
+  result->SetEntries(m_entries.at(systematic));
+
+  return result;
+}
+
+VariationAggregates SystematicHistoResult::aggregateBins(const std::vector<std::size_t>& variations) const {
+  const std::size_t nbins = m_axis.nbinsWithFlows();
+  VariationAggregates result;
+  for (std::size_t i = 0; i < result.contents.size(); ++i) {
+    result.contents[i].resize(nbins, 0.);
+    result.errors[i].resize(nbins, 0.);
+  }
+  if (variations.empty()) return result;
+
+  const double n = variations.size();
+  for (std::size_t ibin = 0; ibin < nbins; ++ibin) {
+    double sum(0);
+    double sum2(0);
+    double sumErrors2(0);
+    std::size_t min = variations.front()*nbins + ibin;
+    std::size_t max = min;
+    for (const std::size_t ivariation : variations) {
+      const std::size_t index = ivariation*nbins + ibin;
+      const double content = m_sumW.at(index);
+      sum  += content;
+      sum2 += content*content;
+      sumErrors2 += m_sumW2.at(index);
+      if (content < m_sumW.at(min)) min = index;
+      if (content > m_sumW.at(max)) max = index;
+    }
+    const double mean = sum/n;
+    const double sigma = n > 1 ? std::sqrt(std::max(0., (sum2 - sum*mean)/(n - 1))) : 0.;
+    const double rmsError = std::sqrt(sumErrors2/n);
+
+    result.contents[static_cast<std::size_t>(VariationAggregate::ENVELOPE_UP)][ibin]   = m_sumW.at(max);
+    result.contents[static_cast<std::size_t>(VariationAggregate::ENVELOPE_DOWN)][ibin] = m_sumW.at(min);
+    result.contents[static_cast<std::size_t>(VariationAggregate::RMS_UP)][ibin]        = mean + sigma;
+    result.contents[static_cast<std::size_t>(VariationAggregate::RMS_DOWN)][ibin]      = mean - sigma;
+    result.errors[static_cast<std::size_t>(VariationAggregate::ENVELOPE_UP)][ibin]     = std::sqrt(m_sumW2.at(max));
+    result.errors[static_cast<std::size_t>(VariationAggregate::ENVELOPE_DOWN)][ibin]   = std::sqrt(m_sumW2.at(min));
+    result.errors[static_cast<std::size_t>(VariationAggregate::RMS_UP)][ibin]          = rmsError;
+    result.errors[static_cast<std::size_t>(VariationAggregate::RMS_DOWN)][ibin]        = rmsError;
+  }
+
+  for (const std::size_t ivariation : variations) {
+    result.entries += m_entries.at(ivariation)/n;
+    for (std::size_t istat = 0; istat < nStats; ++istat) {
+      result.stats[istat] += m_stats.at(ivariation*nStats + istat)/n;
+    }
+  }
+
+  return result;
+}
+
+std::array<std::unique_ptr<TH1D>, 4> SystematicHistoResult::aggregates(const std::vector<std::size_t>& variations, const std::string& name) const {
+  const VariationAggregates bins = this->aggregateBins(variations);
+
+  std::array<std::unique_ptr<TH1D>, 4> result;
+  for (std::size_t i = 0; i < result.size(); ++i) {
+    result[i] = m_axis.emptyHisto(name, m_title);
+    for (std::size_t ibin = 0; ibin < bins.contents[i].size(); ++ibin) {
+      result[i]->SetBinContent(ibin, bins.contents[i][ibin]);
+      result[i]->SetBinError(ibin, bins.errors[i][ibin]);
+    }
+    std::array<double, nStats> stats = bins.stats;
+    result[i]->PutStats(stats.data());
+    result[i]->SetEntries(bins.entries);
+  }
+
+  return result;
+}
+
+SystematicHistoAction::SystematicHistoAction(const HistoAxis& axis, const std::string& title, const std::size_t nSystematics) :
+  m_result(std::make_shared<Result_t>(axis, title, nSystematics)),
+  m_nSystematics(nSystematics),
+  m_nbins(axis.nbinsWithFlows())
+{
+  const std::size_t nSlots = ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : 1;
+  m_sumW.resize(nSlots, std::vector<double>(nSystematics*m_nbins, 0.));
+  m_sumW2.resize(nSlots, std::vector<double>(nSystematics*m_nbins, 0.));
+  m_stats.resize(nSlots, std::vector<double>(nSystematics*Result_t::nStats, 0.));
+  m_entries.resize(nSlots, std::vector<double>(nSystematics, 0.));
+}
+
+void SystematicHistoAction::Exec(unsigned int slot,
+                                 const ROOT::VecOps::RVec<double>& values,
+                                 const ROOT::VecOps::RVec<double>& weights,
+                                 const ROOT::VecOps::RVec<char>& passed) {
+
+  std::vector<double>& sumW    = m_sumW[slot];
+  std::vector<double>& sumW2   = m_sumW2[slot];
+  std::vector<double>& stats   = m_stats[slot];
+  std::vector<double>& entries = m_entries[slot];
+
+  for (std::size_t isyst = 0; isyst < m_nSystematics; ++isyst) {
+    if (!passed[isyst]) continue;
+
+    m_result->fillValue(sumW.data(), sumW2.data(), stats.data(), isyst, values[isyst], weights[isyst]);
+    entries[isyst] += 1;
+  }
+}
+
+void SystematicHistoAction::Finalize() {
+  for (std::size_t islot = 0; islot < m_sumW.size(); ++islot) {
+    m_result->add(m_sumW.at(islot), m_sumW2.at(islot), m_stats.at(islot), m_entries.at(islot));
+  }
+}
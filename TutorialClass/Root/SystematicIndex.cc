@@ -0,0 +1,122 @@
+#include "TutorialClass/SystematicIndex.h"
+
+#include <algorithm>
+
+SystematicIndex::SystematicIndex(const SystematicReplacer& replacer) :
+  m_replacer(replacer),
+  m_nBranches(0),
+  m_nLookups(0),
+  m_nComputed(0)
+{
+  this->update();
+}
+
+std::string SystematicIndex::replaceString(const std::string& original, const std::shared_ptr<Systematic>& systematic) {
+  ++m_nLookups;
+  this->update();
+
+  const std::uint32_t formula = this->formulaId(original);
+  const std::uint32_t systematicId = SystematicIndex::intern(m_systematicIds, systematic->name());
+
+  // the formula does not read any branch varied by the systematic
+  const std::vector<std::uint32_t>& branches = m_formulaBranches.at(formula);
+  if (std::none_of(branches.begin(), branches.end(), [this, systematicId](const std::uint32_t branch) {
+        return this->bit(branch, systematicId);
+      })) {
+    return m_formulas.at(formula);
+  }
+
+  const std::uint64_t key = (static_cast<std::uint64_t>(formula) << 32) | systematicId;
+  auto itr = m_replaced.find(key);
+  if (itr == m_replaced.end()) {
+    ++m_nComputed;
+    itr = m_replaced.emplace(key, m_replacer.replaceString(original, systematic)).first;
+  }
+
+  return itr->second;
+}
+
+bool SystematicIndex::branchExists(const std::string& branch) {
+  this->update();
+
+  return m_allBranches.find(branch) != m_allBranches.end();
+}
+
+bool SystematicIndex::affects(const std::string& branch, const std::string& systematic) {
+  this->update();
+
+  return this->bit(this->branchId(branch), SystematicIndex::intern(m_systematicIds, systematic));
+}
+
+std::uint32_t SystematicIndex::intern(std::unordered_map<std::string, std::uint32_t>& ids, const std::string& text) {
+  auto itr = ids.find(text);
+  if (itr != ids.end()) return itr->second;
+
+  const std::uint32_t id = static_cast<std::uint32_t>(ids.size());
+  ids.emplace(text, id);
+
+  return id;
+}
+
+void SystematicIndex::update() {
+  const std::vector<std::string>& branches = m_replacer.allBranches();
+  if (branches.size() == m_nBranches) return;
+
+  // the replacer matches the branches as substrings of the formulas
+  std::vector<bool> changed(m_formulas.size(), false);
+  for (std::size_t ibranch = m_nBranches; ibranch < branches.size(); ++ibranch) {
+    m_allBranches.emplace(branches.at(ibranch));
+    for (std::size_t iformula = 0; iformula < m_formulas.size(); ++iformula) {
+      if (m_formulas.at(iformula).find(branches.at(ibranch)) != std::string::npos) changed.at(iformula) = true;
+    }
+  }
+  m_nBranches = branches.size();
+
+  if (std::find(changed.begin(), changed.end(), true) == changed.end()) return;
+
+  for (std::size_t iformula = 0; iformula < m_formulas.size(); ++iformula) {
+    if (!changed.at(iformula)) continue;
+    m_formulaBranches.at(iformula).clear();
+    for (const auto& ibranch : m_replacer.listOfVariablesAffected(m_formulas.at(iformula))) {
+      m_formulaBranches.at(iformula).emplace_back(this->branchId(ibranch));
+    }
+  }
+
+  for (auto itr = m_replaced.begin(); itr != m_replaced.end();) {
+    if (changed.at(itr->first >> 32)) {
+      itr = m_replaced.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+std::uint32_t SystematicIndex::branchId(const std::string& branch) {
+  auto itr = m_branchIds.find(branch);
+  if (itr != m_branchIds.end()) return itr->second;
+
+  const std::uint32_t id = SystematicIndex::intern(m_branchIds, branch);
+  std::vector<std::uint64_t> row;
+  for (const auto& isystematic : m_replacer.getListOfEffectiveSystematics({branch})) {
+    const std::uint32_t systematic = SystematicIndex::intern(m_systematicIds, isystematic);
+    if (row.size() <= systematic/64) row.resize(systematic/64 + 1, 0);
+    row[systematic/64] |= std::uint64_t(1) << (systematic%64);
+  }
+  m_bits.emplace_back(std::move(row));
+
+  return id;
+}
+
+std::uint32_t SystematicIndex::formulaId(const std::string& formula) {
+  auto itr = m_formulaIds.find(formula);
+  if (itr != m_formulaIds.end()) return itr->second;
+
+  const std::uint32_t id = SystematicIndex::intern(m_formulaIds, formula);
+  m_formulas.emplace_back(formula);
+  m_formulaBranches.emplace_back();
+  for (const auto& ibranch : m_replacer.listOfVariablesAffected(formula)) {
+    m_formulaBranches.back().emplace_back(this->branchId(ibranch));
+  }
+
+  return id;
+}
@@ -1,8 +1,279 @@
 #include "TutorialClass/TutorialClass.h"
 
+#include "TutorialClass/SampleGraph.h"
+#include "TutorialClass/SumWeightsTable.h"
+#include "TutorialClass/XSectionFileReader.h"
+
 #include "FastFrames/DefineHelpers.h"
+#include "FastFrames/Logger.h"
+#include "FastFrames/Systematic.h"
 #include "FastFrames/UniqueSampleID.h"
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <set>
+
+#include <unistd.h>
+
+namespace {
+
+  /**
+   * @brief Removes the temporary metadata files and restores the sum of weights path of the config
+   * when the initialisation ends, also if it throws
+   *
+   */
+  class TemporaryMetadata {
+  public:
+    explicit TemporaryMetadata(ConfigSetting& config) :
+      m_config(config),
+      m_sumWeightsPath(config.inputSumWeightsPath()) {}
+
+    TemporaryMetadata(const TemporaryMetadata&) = delete;
+    TemporaryMetadata& operator=(const TemporaryMetadata&) = delete;
+
+    ~TemporaryMetadata() {
+      std::error_code error;
+      for (const auto& ipath : m_paths) {
+        std::filesystem::remove_all(ipath, error);
+      }
+      m_config.setInputSumWeightsPath(m_sumWeightsPath);
+    }
+
+    /**
+     * @brief Add a temporary file or directory, empty paths are ignored
+     *
+     * @param path
+     */
+    void add(const std::string& path) {
+      if (!path.empty()) m_paths.emplace_back(path);
+    }
+
+  private:
+    ConfigSetting& m_config;
+    std::string m_sumWeightsPath;
+    std::vector<std::string> m_paths;
+  };
+}
+
+void TutorialClass::init() {
+
+  TemporaryMetadata temporary(*m_config);
+  if (m_config->customOptions().getOption<bool>("indexed_sum_weights", false)) {
+    temporary.add(this->selectSumWeights());
+  }
+
+  // files of the custom option, they are not read by the standard initialisation
+  std::vector<std::string> filteredFiles;
+  const std::string filtered = m_config->customOptions().getOption<std::string>("filtered_xsection_files", "");
+  if (!filtered.empty()) {
+    filteredFiles = StringOperations::splitAndStripString(filtered, ",");
+    for (const auto& ifile : filteredFiles) {
+      if (std::find(m_config->xSectionFiles().begin(), m_config->xSectionFiles().end(), ifile) == m_config->xSectionFiles().end()) continue;
+      LOG(WARNING) << "Cross-section file: " << ifile << " is also in the config, it is read in full by the initialisation\n";
+    }
+  }
+
+  MainFrame::init();
+
+  // the cross sections are set once more from the lines of the used DSIDs only,
+  // the files of the config are memory mapped again instead of being parsed in full a second time
+  if (!filteredFiles.empty()) {
+    std::vector<std::string> xSectionFiles = m_config->xSectionFiles();
+    xSectionFiles.insert(xSectionFiles.end(), filteredFiles.begin(), filteredFiles.end());
+    temporary.add(this->selectXSections(xSectionFiles));
+    m_metadataManager.readXSectionFiles(xSectionFiles, this->usedDSIDs());
+  }
+
+  if (m_config->customOptions().getOption<bool>("single_graph_per_sample", false)) {
+    m_normalisations = std::make_shared<NormalisationTable>(*m_config, m_metadataManager);
+  }
+}
+
+std::vector<int> TutorialClass::usedDSIDs() const {
+
+  std::vector<int> result;
+  for (const auto& isample : m_config->samples()) {
+    for (const auto& iid : isample->uniqueSampleIDs()) {
+      if (iid.isData()) continue;
+      result.emplace_back(iid.dsid());
+    }
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+
+  return result;
+}
+
+std::string TutorialClass::selectXSections(std::vector<std::string>& xSectionFiles) const {
+
+  const std::vector<int> usedDSIDs = this->usedDSIDs();
+  if (usedDSIDs.empty()) {
+    LOG(WARNING) << "No DSIDs known before the initialisation, reading the full cross-section files\n";
+    return "";
+  }
+
+  // one directory per file, the file names are kept
+  const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("xsections_" + std::to_string(::getpid()));
+  for (std::size_t ifile = 0; ifile < xSectionFiles.size(); ++ifile) {
+    const XSectionFileReader reader(xSectionFiles.at(ifile), usedDSIDs);
+    const std::filesystem::path fileDirectory = directory / std::to_string(ifile);
+    std::filesystem::create_directories(fileDirectory);
+    const std::string path = (fileDirectory / std::filesystem::path(xSectionFiles.at(ifile)).filename()).string();
+    reader.write(path);
+
+    LOG(INFO) << "Selected " << reader.lines().size() << " of " << reader.nDSIDLines() << " cross-section lines from: " << xSectionFiles.at(ifile) << "\n";
+    xSectionFiles.at(ifile) = path;
+  }
+
+  return directory.string();
+}
+
+std::string TutorialClass::selectSumWeights() {
+
+  const std::string tablePath = SumWeightsTable::tablePath(m_config->inputSumWeightsPath());
+  if (!std::filesystem::exists(tablePath)) {
+    LOG(WARNING) << "Indexed sum of weights table: " << tablePath << " does not exist, reading: " << m_config->inputSumWeightsPath() << "\n";
+    return "";
+  }
+
+  const SumWeightsTable table(tablePath);
+  if (!table.matches(m_config->inputSumWeightsPath())) {
+    LOG(WARNING) << "Indexed sum of weights table: " << tablePath << " was not produced from the current: " << m_config->inputSumWeightsPath() << ", reading the text file\n";
+    return "";
+  }
+
+  // variations used per UniqueSampleID, an empty set means all variations
+  std::map<UniqueSampleID, std::set<std::string> > used;
+  for (const auto& isample : m_config->samples()) {
+    std::set<std::string> variations;
+    variations.insert(isample->nominalSumWeights());
+    for (const auto& isyst : isample->systematics()) {
+      variations.insert(isyst->sumWeights());
+    }
+    const bool all = variations.count("") > 0;
+
+    for (const auto& iid : isample->uniqueSampleIDs()) {
+      if (iid.isData()) continue;
+      auto itr = used.find(iid);
+      if (itr == used.end()) {
+        used.emplace(iid, all ? std::set<std::string>{} : variations);
+      } else if (all || itr->second.empty()) {
+        itr->second.clear();
+      } else {
+        itr->second.insert(variations.begin(), variations.end());
+      }
+    }
+  }
+
+  if (used.empty()) {
+    LOG(WARNING) << "No UniqueSampleIDs known before the initialisation, reading: " << m_config->inputSumWeightsPath() << "\n";
+    return "";
+  }
+
+  const std::string result = (std::filesystem::temp_directory_path() / ("sum_of_weights_" + std::to_string(::getpid()) + ".txt")).string();
+  std::ofstream out(result);
+  if (!out.good()) {
+    LOG(ERROR) << "Cannot open file: " << result << "\n";
+    throw std::invalid_argument("");
+  }
+  out << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+  std::size_t nEntries(0);
+  for (const auto& [id, variations] : used) {
+    const auto sumWeights = table.sumWeights(id);
+    if (sumWeights.empty()) {
+      LOG(WARNING) << "UniqueSampleID: " << id << " not found in: " << tablePath << "\n";
+    }
+    for (const auto& [variation, value] : sumWeights) {
+      if (!variations.empty() && variations.count(variation) == 0) continue;
+      out << id << " " << variation << " " << value << "\n";
+      ++nEntries;
+    }
+  }
+
+  LOG(INFO) << "Read " << nEntries << " of " << table.size() << " sums of weights for " << used.size() << " UniqueSampleIDs from: " << tablePath << "\n";
+
+  m_config->setInputSumWeightsPath(result);
+  return result;
+}
+
+void TutorialClass::executeHistograms() {
+
+  if (!m_config->customOptions().getOption<bool>("single_graph_per_sample", false)) {
+    // the standard processing cannot stop before the event loop
+    if (m_config->customOptions().getOption<bool>("dry_run", false)) {
+      LOG(ERROR) << "Custom option dry_run requires single_graph_per_sample: true\n";
+      throw std::invalid_argument("");
+    }
+    MainFrame::executeHistograms();
+    return;
+  }
+
+  if (!m_normalisations) {
+    m_normalisations = std::make_shared<NormalisationTable>(*m_config, m_metadataManager);
+  }
+
+  SampleGraph graph(*this, m_config, m_metadataManager, *m_normalisations, m_systReplacer, &m_batchedColumns);
+
+  std::vector<std::shared_ptr<Sample> > standardSamples;
+  for (const auto& isample : m_config->samples()) {
+    if (!SampleGraph::isSupported(isample, m_config)) {
+      LOG(INFO) << "Sample: " << isample->name() << " is not supported by the single graph processing, using the standard processing\n";
+      standardSamples.emplace_back(isample);
+      continue;
+    }
+    m_deferBatchedVariations = true;
+    graph.processSample(isample);
+    m_deferBatchedVariations = false;
+  }
+
+  if (standardSamples.empty()) return;
+
+  if (m_config->customOptions().getOption<bool>("dry_run", false)) {
+    for (const auto& isample : standardSamples) {
+      LOG(WARNING) << "Sample: " << isample->name() << " uses the standard processing, no dry run plan is available for it\n";
+    }
+    return;
+  }
+
+  // run the standard processing only on the remaining samples
+  std::vector<std::shared_ptr<Sample> > allSamples = m_config->samples();
+  m_config->samples() = standardSamples;
+  MainFrame::executeHistograms();
+  m_config->samples() = allSamples;
+}
+
+void TutorialClass::executeNtuples() {
+
+  if (m_config->customOptions().getOption<bool>("dry_run", false)) {
+    LOG(ERROR) << "Custom option dry_run is only supported for histograms, not for ntuples\n";
+    throw std::invalid_argument("");
+  }
+
+  MainFrame::executeNtuples();
+}
+
+ROOT::RDF::RNode TutorialClass::defineBatchedVariations(ROOT::RDF::RNode node, const std::string& newVariable) const {
+
+  auto itr = m_batchedColumns.find(newVariable);
+  if (itr == m_batchedColumns.end()) {
+    LOG(ERROR) << "Variable: " << newVariable << " is not defined by systematicDefineBatched\n";
+    throw std::invalid_argument("");
+  }
+
+  for (std::size_t i = 0; i < itr->second.variations.size(); ++i) {
+    const std::string systName = StringOperations::replaceString(newVariable, "NOSYS", itr->second.variations.at(i));
+    if (node.HasColumn(systName)) continue;
+    node = itr->second.defineVariation(node, i);
+  }
+
+  return node;
+}
+
 ROOT::RDF::RNode TutorialClass::defineVariables(ROOT::RDF::RNode mainNode,
                                                 const std::shared_ptr<Sample>& /*sample*/,
                                                 const UniqueSampleID& /*id*/) {
@@ -20,6 +291,38 @@ ROOT::RDF::RNode TutorialClass::defineVariables(ROOT::RDF::RNode mainNode,
     return DefineHelpers::sortedPassedVector(fourVec,selected);
   };
 
+  // same as SortedTLVs, called once for all systematic variations of the inputs
+  auto SortedTLVsBatched = [](const SystematicBatch<std::vector<ROOT::Math::PtEtaPhiEVector> >& fourVec,
+                              const SystematicBatch<std::vector<char> >& selected) {
+    std::vector<std::vector<ROOT::Math::PtEtaPhiEVector> > result;
+    result.reserve(fourVec.size());
+
+    // the selection is often not varied, the passed jets are then only found once
+    std::vector<std::size_t> nominalPassed;
+    std::vector<std::size_t> passed;
+    for (std::size_t i = 0; i < fourVec.size(); ++i) {
+      const bool nominalSelection = i > 0 && selected.sameAs(i, 0);
+      if (!nominalSelection) {
+        passed.clear();
+        for (std::size_t ijet = 0; ijet < selected[i].size(); ++ijet) {
+          if (selected[i].at(ijet)) passed.emplace_back(ijet);
+        }
+        if (i == 0) nominalPassed = passed;
+      }
+
+      std::vector<ROOT::Math::PtEtaPhiEVector> sorted;
+      for (const std::size_t ijet : nominalSelection ? nominalPassed : passed) {
+        sorted.emplace_back(fourVec[i].at(ijet));
+      }
+      std::sort(sorted.begin(), sorted.end(), [](const ROOT::Math::PtEtaPhiEVector& a, const ROOT::Math::PtEtaPhiEVector& b) {
+        return a.pt() > b.pt();
+      });
+      result.emplace_back(std::move(sorted));
+    }
+
+    return result;
+  };
+
   auto LeadingTLV = [](const std::vector<ROOT::Math::PtEtaPhiEVector>& fourVec) {
     return fourVec.empty() ? ROOT::Math::PtEtaPhiEVector{-999, -999, -999, -999} : fourVec.at(0);
   };
@@ -28,6 +331,37 @@ ROOT::RDF::RNode TutorialClass::defineVariables(ROOT::RDF::RNode mainNode,
     return tlv.pt()/1.e3;
   };
 
+  // the batched defines read the results of the previous ones by index,
+  // only the variations of jet1_pt_GEV used by the config get their own column
+  if (m_config->customOptions().getOption<bool>("batched_defines", false)) {
+    auto LeadingTLVBatched = [LeadingTLV](const SystematicBatch<std::vector<ROOT::Math::PtEtaPhiEVector> >& fourVec) {
+      std::vector<ROOT::Math::PtEtaPhiEVector> result;
+      result.reserve(fourVec.size());
+      for (std::size_t i = 0; i < fourVec.size(); ++i) {
+        result.emplace_back(LeadingTLV(fourVec[i]));
+      }
+      return result;
+    };
+
+    auto tlvPtGEVBatched = [tlvPtGEV](const SystematicBatch<ROOT::Math::PtEtaPhiEVector>& tlv) {
+      std::vector<double> result;
+      result.reserve(tlv.size());
+      for (std::size_t i = 0; i < tlv.size(); ++i) {
+        result.emplace_back(tlvPtGEV(tlv[i]));
+      }
+      return result;
+    };
+
+    mainNode = this->systematicDefineBatched(mainNode,
+                                             "sorted_jet_TLV_NOSYS",
+                                             SortedTLVsBatched,
+                                             {"jet_TLV_NOSYS", "jet_select_baselineJvt_NOSYS"});
+    mainNode = this->systematicDefineBatched(mainNode, "jet1_TLV_NOSYS", LeadingTLVBatched, {"sorted_jet_TLV_NOSYS"});
+    mainNode = this->systematicDefineBatched(mainNode, "jet1_pt_GEV_NOSYS", tlvPtGEVBatched, {"jet1_TLV_NOSYS"});
+
+    return mainNode;
+  }
+
   // add sorted passed jet TLV vector
   mainNode = MainFrame::systematicDefine(mainNode,
                                          "sorted_jet_TLV_NOSYS",
@@ -0,0 +1,64 @@
+#include "TutorialClass/XSectionFileReader.h"
+
+#include "FastFrames/Logger.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+
+XSectionFileReader::XSectionFileReader(const std::string& path, const std::vector<int>& usedDSIDs) :
+  m_file(path),
+  m_nDSIDLines(0)
+{
+  const std::string_view content = m_file.view();
+
+  std::size_t begin(0);
+  while (begin < content.size()) {
+    std::size_t end = content.find('\n', begin);
+    if (end == std::string_view::npos) end = content.size();
+    const std::string_view line = content.substr(begin, end - begin);
+    begin = end + 1;
+
+    int dsid;
+    if (!readDSID(line, dsid)) {
+      m_header.emplace_back(line);
+      continue;
+    }
+
+    ++m_nDSIDLines;
+    if (!std::binary_search(usedDSIDs.begin(), usedDSIDs.end(), dsid)) continue;
+    m_lines.emplace_back(dsid, line);
+  }
+
+  // the same DSID can appear several times, keep the order of the file, the XSectionManager checks them
+  std::stable_sort(m_lines.begin(), m_lines.end(), [](const auto& a, const auto& b){return a.first < b.first;});
+}
+
+void XSectionFileReader::write(const std::string& path) const {
+
+  std::ofstream out(path);
+  if (!out.good()) {
+    LOG(ERROR) << "Cannot open file: " << path << "\n";
+    throw std::invalid_argument("");
+  }
+
+  for (const auto& iline : m_header) {
+    out << iline << "\n";
+  }
+  for (const auto& iline : m_lines) {
+    out << iline.second << "\n";
+  }
+}
+
+bool XSectionFileReader::readDSID(std::string_view line, int& dsid) {
+  const std::size_t first = line.find_first_not_of(" \t");
+  if (first == std::string_view::npos) return false;
+
+  const char* end = line.data() + line.size();
+  const auto [next, error] = std::from_chars(line.data() + first, end, dsid);
+  if (error != std::errc()) return false;
+
+  // the DSID has to be a full column
+  return next == end || *next == ' ' || *next == '\t' || *next == '\r';
+}
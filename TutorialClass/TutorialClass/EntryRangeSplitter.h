@@ -0,0 +1,187 @@
+/**
+ * @file EntryRangeSplitter.h
+ * @brief Splitting of the input entries into jobs balanced by events and bytes
+ *
+ */
+
+#pragma once
+
+#include "Rtypes.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+class InputSchemaCache;
+class TFile;
+
+/**
+ * @brief Entries of one input file processed by a job
+ *
+ */
+struct EntryRange {
+  std::size_t file;
+  std::string path;
+  Long64_t begin;
+  Long64_t end;
+};
+
+/**
+ * @brief Splits the entries of a list of files into contiguous ranges, one per job, with similar cost.
+ * The cost of a file is its fraction of all entries plus its fraction of all compressed bytes, spread uniformly
+ * over its entries. The boundaries between the jobs are aligned to the TTree clusters.
+ * The entries, compressed sizes and cluster boundaries are taken from the file entries table written by produce-metadata
+ * (see MetadataProducer), from the InputSchemaCache or, as the last resort, read from the files
+ *
+ */
+class EntryRangeSplitter {
+public:
+
+  /**
+   * @brief Information about one file
+   *
+   */
+  struct FileInfo {
+    std::string path;
+    Long64_t entries = 0;
+    Long64_t zipBytes = 0;
+    std::vector<Long64_t> clusters;
+  };
+
+  /**
+   * @brief Construct a new Entry Range Splitter object
+   *
+   * @param treeName Name of the TTree
+   * @param cache Cache of the file information, can be nullptr
+   */
+  explicit EntryRangeSplitter(const std::string& treeName, const InputSchemaCache* cache);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  EntryRangeSplitter() = delete;
+
+  /**
+   * @brief Destroy the Entry Range Splitter object
+   *
+   */
+  ~EntryRangeSplitter() = default;
+
+  /**
+   * @brief Read the file entries table, the entries of its files for the tree of the splitter are not read from the files.
+   * A missing table is not an error
+   *
+   * @param path
+   * @return true if the table exists
+   */
+  bool readFileEntries(const std::string& path);
+
+  /**
+   * @brief Add a file, the order of the files is kept
+   *
+   * @param path
+   */
+  void addFile(const std::string& path);
+
+  /**
+   * @brief Only split the entries [begin, end) of all files (counted over the files in the order they were added),
+   * used for the event range of the config
+   *
+   * @param begin First entry
+   * @param end Entry after the last one, negative means until the end of the last file
+   */
+  void selectEntries(const Long64_t begin, const Long64_t end);
+
+  /**
+   * @brief Ranges of a job, ordered as the files. Files fully processed by the job have the range [0, entries).
+   * The ranges are contiguous, only the first and the last one can be partial
+   *
+   * @param nJobs Number of jobs
+   * @param jobIndex Index of the job
+   * @return std::vector<EntryRange>
+   */
+  std::vector<EntryRange> jobRanges(const std::size_t nJobs, const std::size_t jobIndex) const;
+
+  /**
+   * @brief Number of entries of a file
+   *
+   * @param file Position of the file
+   * @return Long64_t
+   */
+  inline Long64_t entries(const std::size_t file) const {return m_files.at(file).entries;}
+
+  /**
+   * @brief Number of files added that were neither in the file entries table nor in the cache and had to be opened
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nOpenedFiles() const {return m_nOpenedFiles;}
+
+  /**
+   * @brief Path of the file entries table in a metadata directory (next to filelist.txt)
+   *
+   * @param directory
+   * @return std::string
+   */
+  static std::string fileEntriesPath(const std::string& directory);
+
+  /**
+   * @brief Write the file entries table, one line per file: tree name, path, entries, compressed bytes and cluster starts
+   *
+   * @param path Path of the table
+   * @param treeName Name of the TTree
+   * @param files
+   */
+  static void writeFileEntries(const std::string& path, const std::string& treeName, const std::vector<FileInfo>& files);
+
+  /**
+   * @brief Read the entries, the compressed size and the cluster boundaries of a tree from an open file,
+   * files without the tree have no entries
+   *
+   * @param file
+   * @param treeName
+   * @return FileInfo
+   */
+  static FileInfo readTree(TFile& file, const std::string& treeName);
+
+private:
+
+  /**
+   * @brief Open the file and read the information of the tree
+   *
+   * @param path
+   * @return FileInfo
+   */
+  FileInfo readFile(const std::string& path) const;
+
+  /**
+   * @brief Global entry of the boundary before a job, aligned to the clusters
+   *
+   * @param nJobs
+   * @param jobIndex
+   * @return Long64_t
+   */
+  Long64_t boundary(const std::size_t nJobs, const std::size_t jobIndex) const;
+
+  /**
+   * @brief Selected entries of all files
+   *
+   * @return Long64_t
+   */
+  Long64_t selectedEnd() const;
+
+  std::string m_treeName;
+  const InputSchemaCache* m_cache;
+  std::vector<FileInfo> m_files;
+  Long64_t m_begin;
+  Long64_t m_end;
+
+  /**
+   * @brief Path | information, from the file entries table
+   *
+   */
+  std::map<std::string, FileInfo> m_fileEntries;
+  std::size_t m_nOpenedFiles;
+};
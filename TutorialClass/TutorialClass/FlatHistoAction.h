@@ -0,0 +1,460 @@
+/**
+ * @file FlatHistoAction.h
+ * @brief RDataFrame action filling 1D, 2D and 3D histograms into flat per-slot buffers
+ *
+ */
+
+#pragma once
+
+#include "TutorialClass/HistoAxis.h"
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include "TROOT.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class TH1;
+class TTreeReader;
+
+/**
+ * @brief Result of the FlatHistoAction.
+ * Stores sum of weights and sum of squared weights per global bin (same numbering as TH1::GetBin)
+ * and the statistics used for the mean and RMS (same layout as TH1::GetStats)
+ *
+ */
+class FlatHistoResult {
+public:
+
+  /**
+   * @brief Number of statistics of a 3D histogram: sumw, sumw2, sumwx, sumwx2, sumwy, sumwy2, sumwxy,
+   * sumwz, sumwz2, sumwxz, sumwyz. 1D and 2D histograms use the first 4 and 7
+   *
+   */
+  static constexpr std::size_t nStats = 11;
+
+  using Stats = std::array<double, nStats>;
+
+  /**
+   * @brief Construct a new Flat Histo Result object
+   *
+   * @param axes Binning of each dimension
+   * @param nSamples Number of UniqueSampleIDs whose content without normalisation is also kept, 0 if not needed
+   */
+  explicit FlatHistoResult(const std::vector<HistoAxis>& axes, const std::size_t nSamples = 0);
+
+  /**
+   * @brief Destroy the Flat Histo Result object
+   *
+   */
+  ~FlatHistoResult() = default;
+
+  /**
+   * @brief Number of cells including underflow and overflow in all dimensions
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nCells() const {return m_sumW.size();}
+
+  /**
+   * @brief Sum of weights of a cell
+   *
+   * @param cell Global bin
+   * @return double
+   */
+  inline double sumW(const std::size_t cell) const {return m_sumW.at(cell);}
+
+  /**
+   * @brief Sum of squared weights of a cell
+   *
+   * @param cell Global bin
+   * @return double
+   */
+  inline double sumW2(const std::size_t cell) const {return m_sumW2.at(cell);}
+
+  /**
+   * @brief Get the global bin for the values, one per dimension
+   *
+   * @param values
+   * @param inRange Set to false if a value is in the underflow or overflow of its axis
+   * @return std::size_t
+   */
+  std::size_t cell(const double* values, bool* inRange = nullptr) const;
+
+  /**
+   * @brief Fill one point into per-slot content. As in TH1::Fill, only points within
+   * the ranges of all axes enter the statistics
+   *
+   * @param sumW
+   * @param sumW2
+   * @param stats
+   * @param values One value per dimension
+   * @param weight
+   */
+  inline void fillPoint(double* sumW, double* sumW2, Stats& stats, const double* values, const double weight) const {
+    bool inRange(true);
+    const std::size_t index = this->cell(values, &inRange);
+    sumW[index]  += weight;
+    sumW2[index] += weight*weight;
+    if (!inRange) return;
+
+    stats[0] += weight;
+    stats[1] += weight*weight;
+    stats[2] += weight*values[0];
+    stats[3] += weight*values[0]*values[0];
+    if (m_axes.size() < 2) return;
+    stats[4] += weight*values[1];
+    stats[5] += weight*values[1]*values[1];
+    stats[6] += weight*values[0]*values[1];
+    if (m_axes.size() < 3) return;
+    stats[7]  += weight*values[2];
+    stats[8]  += weight*values[2]*values[2];
+    stats[9]  += weight*values[0]*values[2];
+    stats[10] += weight*values[1]*values[2];
+  }
+
+  /**
+   * @brief Add (merge) per-slot content
+   *
+   * @param sumW
+   * @param sumW2
+   * @param stats
+   * @param entries
+   * @param scale Scale of the weights of the content (e.g. normalisation applied after the filling)
+   */
+  void add(const std::vector<double>& sumW,
+           const std::vector<double>& sumW2,
+           const Stats& stats,
+           const double entries,
+           const double scale = 1.);
+
+  /**
+   * @brief Add content without normalisation of one UniqueSampleID, kept separately from the normalised content
+   *
+   * @param sample Index of the UniqueSampleID
+   * @param sumW
+   * @param sumW2
+   * @param stats
+   * @param entries
+   */
+  void addSample(const std::size_t sample,
+                 const std::vector<double>& sumW,
+                 const std::vector<double>& sumW2,
+                 const Stats& stats,
+                 const double entries);
+
+  /**
+   * @brief Number of UniqueSampleIDs whose content without normalisation is kept
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nSamples() const {return m_samples.size();}
+
+  /**
+   * @brief Content without normalisation of one UniqueSampleID
+   *
+   * @param sample Index of the UniqueSampleID
+   * @return const FlatHistoResult* nullptr if the UniqueSampleID did not fill the histogram
+   */
+  inline const FlatHistoResult* sample(const std::size_t sample) const {return m_samples.at(sample).get();}
+
+  /**
+   * @brief Memory of the content kept per UniqueSampleID
+   *
+   * @return std::size_t Bytes
+   */
+  std::size_t sampleBytes() const;
+
+  /**
+   * @brief Copy the content to a histogram with the same binning, only to be called when writing the output
+   *
+   * @param histo
+   */
+  void fill(TH1* histo) const;
+
+private:
+  std::vector<HistoAxis> m_axes;
+  std::vector<double> m_sumW;
+  std::vector<double> m_sumW2;
+  Stats m_stats;
+  double m_entries;
+
+  /**
+   * @brief Content without normalisation per UniqueSampleID, allocated when the UniqueSampleID is added
+   *
+   */
+  std::vector<std::shared_ptr<FlatHistoResult> > m_samples;
+};
+
+namespace FlatHistoDetail {
+
+  template<typename T, typename = void>
+  struct IsContainer : std::false_type {};
+
+  template<typename T>
+  struct IsContainer<T, std::void_t<decltype(std::declval<T>().size()), decltype(std::declval<T>()[0])> > : std::true_type {};
+
+  /**
+   * @brief Number of fills for one event: scalars are used for every element of the containers,
+   * the containers need to have the same size
+   *
+   * @tparam ColumnTypes
+   * @param values
+   * @return std::size_t
+   */
+  template<typename... ColumnTypes>
+  std::size_t fillSize(const ColumnTypes&... values) {
+    std::size_t result(1);
+    bool hasContainer(false);
+    auto check = [&result, &hasContainer](const auto& value) {
+      if constexpr (IsContainer<std::decay_t<decltype(value)> >::value) {
+        if (hasContainer && value.size() != result) {
+          throw std::runtime_error("FlatHistoAction: containers of different sizes cannot be filled together");
+        }
+        result = value.size();
+        hasContainer = true;
+      }
+    };
+    (check(values), ...);
+
+    return result;
+  }
+
+  /**
+   * @brief Get the i-th value of a container or the value of a scalar
+   *
+   * @tparam T
+   * @param value
+   * @param i
+   * @return double
+   */
+  template<typename T>
+  double valueAt(const T& value, const std::size_t i) {
+    if constexpr (IsContainer<T>::value) {
+      return static_cast<double>(value[i]);
+    } else {
+      (void)i;
+      return static_cast<double>(value);
+    }
+  }
+}
+
+/**
+ * @brief Custom RDataFrame action that fills a histogram into flat sum of weights buffers.
+ * Unlike Histo1D/2D/3D, no histogram object is kept per slot, the buffers of a slot
+ * are only allocated when the slot fills the histogram for the first time.
+ * Columns can be scalars or containers, the last column is the weight. When normalisations per UniqueSampleID
+ * are given, the weight is followed by the index of the UniqueSampleID. Each slot fills one UniqueSampleID at a time
+ * (the entries of a UniqueSampleID are contiguous in the input), its buffer is scaled by the normalisation
+ * and added to the result when the slot moves to another UniqueSampleID and in Finalize.
+ * The memory does not depend on the number of UniqueSampleIDs, unless their content without normalisation is kept
+ *
+ * @tparam ColumnTypes Types of the filled columns, one per dimension
+ */
+template<typename... ColumnTypes>
+class FlatHistoAction : public ROOT::Detail::RDF::RActionImpl<FlatHistoAction<ColumnTypes...> > {
+public:
+
+  using Result_t = FlatHistoResult;
+
+  /**
+   * @brief Construct a new Flat Histo Action object
+   *
+   * @param axes Binning of each dimension
+   * @param normalisations Normalisation per UniqueSampleID applied after the filling, empty if the weight is normalised
+   * @param keepSamples Also keep the content without normalisation of each UniqueSampleID in the result
+   */
+  explicit FlatHistoAction(const std::vector<HistoAxis>& axes,
+                           const std::vector<double>& normalisations = {},
+                           const bool keepSamples = false) :
+    m_result(std::make_shared<Result_t>(axes, keepSamples ? normalisations.size() : 0)),
+    m_normalisations(normalisations),
+    m_sumW(ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : 1),
+    m_sumW2(m_sumW.size()),
+    m_stats(m_sumW.size(), FlatHistoResult::Stats{}),
+    m_entries(m_sumW.size(), 0.),
+    m_samples(m_sumW.size(), noSample),
+    m_mutex(std::make_unique<std::mutex>())
+  {
+    static_assert(sizeof...(ColumnTypes) > 0 && sizeof...(ColumnTypes) <= 3, "Only 1D, 2D and 3D histograms are supported");
+    if (axes.size() != sizeof...(ColumnTypes)) {
+      throw std::invalid_argument("FlatHistoAction: number of axes does not match the number of columns");
+    }
+  }
+
+  /**
+   * @brief Deleted copy constructor
+   *
+   */
+  FlatHistoAction(const FlatHistoAction&) = delete;
+
+  /**
+   * @brief Default move constructor
+   *
+   */
+  FlatHistoAction(FlatHistoAction&&) = default;
+
+  /**
+   * @brief Destroy the Flat Histo Action object
+   *
+   */
+  ~FlatHistoAction() = default;
+
+  /**
+   * @brief Get the result (needed by RDataFrame)
+   *
+   * @return std::shared_ptr<Result_t>
+   */
+  std::shared_ptr<Result_t> GetResultPtr() const {return m_result;}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void Initialize() {}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void InitTask(TTreeReader*, unsigned int) {}
+
+  /**
+   * @brief Fill the event
+   *
+   * @param slot
+   * @param values One value (or container) per dimension
+   * @param weight
+   */
+  void Exec(unsigned int slot, const ColumnTypes&... values, const double weight) {
+    this->fill(slot, values..., weight);
+  }
+
+  /**
+   * @brief Fill the event with the weight without normalisation
+   *
+   * @param slot
+   * @param values One value (or container) per dimension
+   * @param weight
+   * @param sample Index of the UniqueSampleID
+   */
+  void Exec(unsigned int slot, const ColumnTypes&... values, const double weight, const std::size_t sample) {
+    if (sample != m_samples[slot]) {
+      this->flush(slot);
+      m_samples[slot] = sample;
+    }
+    this->fill(slot, values..., weight);
+  }
+
+  /**
+   * @brief Merge the per-slot content into the result
+   *
+   */
+  void Finalize() {
+    for (std::size_t slot = 0; slot < m_sumW.size(); ++slot) {
+      this->flush(slot);
+    }
+  }
+
+  /**
+   * @brief Name of the action
+   *
+   * @return std::string
+   */
+  std::string GetActionName() const {return "FlatHisto";}
+
+  /**
+   * @brief Memory of the allocated per-slot buffers and of the content kept per UniqueSampleID
+   *
+   * @return std::size_t Bytes
+   */
+  std::size_t bufferBytes() const {
+    std::size_t result(m_result->sampleBytes());
+    for (std::size_t slot = 0; slot < m_sumW.size(); ++slot) {
+      result += (m_sumW.at(slot).size() + m_sumW2.at(slot).size())*sizeof(double);
+    }
+    return result;
+  }
+
+private:
+
+  /**
+   * @brief Fill the event into the buffer of a slot
+   *
+   * @param slot
+   * @param values
+   * @param weight
+   */
+  void fill(const std::size_t slot, const ColumnTypes&... values, const double weight) {
+    std::vector<double>& sumW  = m_sumW[slot];
+    std::vector<double>& sumW2 = m_sumW2[slot];
+    if (sumW.empty()) {
+      sumW.resize(m_result->nCells(), 0.);
+      sumW2.resize(m_result->nCells(), 0.);
+    }
+
+    const std::size_t n = FlatHistoDetail::fillSize(values...);
+    for (std::size_t i = 0; i < n; ++i) {
+      const double point[] = {FlatHistoDetail::valueAt(values, i)...};
+      m_result->fillPoint(sumW.data(), sumW2.data(), m_stats[slot], point, weight);
+    }
+    m_entries[slot] += n;
+  }
+
+  /**
+   * @brief Add the buffer of a slot to the result, scaled by the normalisation of its UniqueSampleID, and reset it.
+   * Other slots can flush at the same time when the normalisation is applied after the filling
+   *
+   * @param slot
+   */
+  void flush(const std::size_t slot) {
+    if (m_entries[slot] == 0) return;
+
+    std::vector<double>& sumW  = m_sumW[slot];
+    std::vector<double>& sumW2 = m_sumW2[slot];
+    {
+      std::lock_guard<std::mutex> lock(*m_mutex);
+      if (m_normalisations.empty()) {
+        m_result->add(sumW, sumW2, m_stats[slot], m_entries[slot]);
+      } else {
+        const std::size_t sample = m_samples[slot];
+        m_result->add(sumW, sumW2, m_stats[slot], m_entries[slot], m_normalisations.at(sample));
+        if (m_result->nSamples() > 0) m_result->addSample(sample, sumW, sumW2, m_stats[slot], m_entries[slot]);
+      }
+    }
+
+    std::fill(sumW.begin(), sumW.end(), 0.);
+    std::fill(sumW2.begin(), sumW2.end(), 0.);
+    m_stats[slot] = FlatHistoResult::Stats{};
+    m_entries[slot] = 0;
+  }
+
+  static constexpr std::size_t noSample = std::numeric_limits<std::size_t>::max();
+
+  std::shared_ptr<Result_t> m_result;
+  std::vector<double> m_normalisations;
+
+  /**
+   * @brief per slot content, empty until the slot fills the histogram
+   *
+   */
+  std::vector<std::vector<double> > m_sumW;
+  std::vector<std::vector<double> > m_sumW2;
+  std::vector<FlatHistoResult::Stats> m_stats;
+  std::vector<double> m_entries;
+
+  /**
+   * @brief per slot index of the UniqueSampleID of the content, only used with post-fill normalisation
+   *
+   */
+  std::vector<std::size_t> m_samples;
+  std::unique_ptr<std::mutex> m_mutex;
+};
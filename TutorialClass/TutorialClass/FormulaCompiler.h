@@ -0,0 +1,179 @@
+/**
+ * @file FormulaCompiler.h
+ * @brief Ahead-of-time compilation of string formulas into typed RDataFrame Defines and Filters
+ *
+ */
+
+#pragma once
+
+#include "ROOT/RDataFrame.hxx"
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Class that replaces the JIT compiled string Defines and Filters with typed lambdas compiled into a shared library.
+ * Every formula is identified by a symbol built from the formula and the types of the columns it reads.
+ * The directory is a persistent cache shared between jobs: the index files map the symbols to the libraries
+ * and a library is only loaded when one of its formulas is used.
+ * If the symbol is in the index, the compiled function books the typed Define/Filter.
+ * Otherwise the formula is JIT compiled as usual and its typed code is stored, compile() then builds a new library
+ * so that the next runs with the same formulas do not need JIT at all.
+ * Formulas that cannot be compiled are stored in the index without a library and are always JIT compiled.
+ *
+ */
+class FormulaCompiler {
+public:
+
+  /**
+   * @brief Signature of the generated functions
+   *
+   */
+  using CompiledFunction = void (*)(ROOT::RDF::RNode&, const std::string&);
+
+  /**
+   * @brief Construct a new Formula Compiler object
+   *
+   * @param directory Directory with the generated sources and libraries
+   * @param headers Headers included by the generated code, e.g. with the functions called in the formulas
+   */
+  explicit FormulaCompiler(const std::string& directory, const std::vector<std::string>& headers = {});
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  FormulaCompiler() = delete;
+
+  /**
+   * @brief Destroy the Formula Compiler object
+   *
+   */
+  ~FormulaCompiler() = default;
+
+  /**
+   * @brief Read the index files of the compiled formulas from the directory
+   *
+   */
+  void readIndex();
+
+  /**
+   * @brief Define a new column from a formula
+   *
+   * @param node
+   * @param name Name of the new column
+   * @param formula
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode define(ROOT::RDF::RNode node, const std::string& name, const std::string& formula);
+
+  /**
+   * @brief Apply a filter from a formula
+   *
+   * @param node
+   * @param formula
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode filter(ROOT::RDF::RNode node, const std::string& formula);
+
+  /**
+   * @brief Get the columns used by a formula
+   *
+   * @param node
+   * @param formula
+   * @return std::vector<std::string>
+   */
+  static std::vector<std::string> columnsInFormula(ROOT::RDF::RNode node, const std::string& formula);
+
+  /**
+   * @brief Generate the source code for the formulas that were JIT compiled and compile it into a new library.
+   * Formulas compiled by other jobs in the meantime are skipped, the library is built in a private directory
+   * and moved to the cache before it is added to the index. If the compilation fails, the formulas are
+   * compiled in halves until the formulas that do not compile are isolated, those are added to the index
+   * as failed
+   *
+   */
+  void compile();
+
+  /**
+   * @brief Number of formulas using the compiled code
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nCompiled() const {return m_nCompiled;}
+
+  /**
+   * @brief Number of formulas that were JIT compiled and wait for compile()
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nPending() const {return m_pending.size();}
+
+private:
+
+  /**
+   * @brief Find the compiled function or store the code for the next compilation
+   *
+   * @param node
+   * @param formula
+   * @param isFilter
+   * @return CompiledFunction nullptr if not compiled yet
+   */
+  CompiledFunction find(ROOT::RDF::RNode node, const std::string& formula, const bool isFilter);
+
+  /**
+   * @brief Compile a batch of formulas into a library and add it to the index,
+   * bisect the batch if the compilation fails
+   *
+   * @param formulas Symbol | generated code
+   * @param failed Filled with the symbols of the formulas that cannot be compiled
+   */
+  void compileBatch(const std::vector<std::pair<std::string, std::string> >& formulas,
+                    std::vector<std::string>& failed);
+
+  /**
+   * @brief Write an index file and add its entries to the index
+   *
+   * @param name Name of the index file, without extension
+   * @param entries Symbol | library
+   */
+  void writeIndex(const std::string& name, const std::vector<std::pair<std::string, std::string> >& entries);
+
+  /**
+   * @brief Path of the index directory, with one file listing the symbols of each library
+   *
+   * @return std::string
+   */
+  std::string indexDirectory() const;
+
+  /**
+   * @brief Library of the formulas that cannot be compiled in the index
+   *
+   */
+  static constexpr const char* failedLibrary = "-";
+
+  std::string m_directory;
+  std::vector<std::string> m_headers;
+
+  /**
+   * @brief Symbol | library in the directory, failedLibrary for the formulas that cannot be compiled
+   *
+   */
+  std::map<std::string, std::string> m_index;
+
+  /**
+   * @brief Libraries already loaded
+   *
+   */
+  std::set<std::string> m_loaded;
+
+  /**
+   * @brief Symbol | generated code, for the formulas not compiled yet
+   *
+   */
+  std::vector<std::pair<std::string, std::string> > m_pending;
+  std::size_t m_nCompiled;
+};
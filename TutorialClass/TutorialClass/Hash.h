@@ -0,0 +1,35 @@
+/**
+ * @file Hash.h
+ * @brief Stable 64 bit hash used for the names of the files in the persistent caches
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Hash {
+
+  /**
+   * @brief Initial value of the FNV-1a hash
+   *
+   */
+  constexpr std::uint64_t fnv1aOffset = 14695981039346656037ull;
+
+  /**
+   * @brief Add a text to a FNV-1a hash. Unlike std::hash, the result is the same for all builds and platforms
+   *
+   * @param text
+   * @param result Hash of the previous texts
+   * @return std::uint64_t
+   */
+  inline std::uint64_t fnv1a(const std::string& text, std::uint64_t result = fnv1aOffset) {
+    for (const char c : text) {
+      result ^= static_cast<unsigned char>(c);
+      result *= 1099511628211ull;
+    }
+
+    return result;
+  }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file HistoAxis.h
+ * @brief Binning of a histogram axis used by the flat histogram actions
+ *
+ */
+
+#pragma once
+
+#include "TH1D.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Variable;
+
+/**
+ * @brief Binning of a histogram axis with a fast bin lookup
+ *
+ */
+class HistoAxis {
+public:
+
+  /**
+   * @brief Construct a new Histo Axis object from a Variable
+   *
+   * @param variable
+   */
+  explicit HistoAxis(const Variable& variable);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  HistoAxis() = delete;
+
+  /**
+   * @brief Destroy the Histo Axis object
+   *
+   */
+  ~HistoAxis() = default;
+
+  /**
+   * @brief Get the bin index including underflow (0) and overflow (nbins + 1)
+   *
+   * @param value
+   * @return std::size_t
+   */
+  std::size_t findBin(const double value) const;
+
+  /**
+   * @brief Number of bins (without underflow and overflow)
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nbins() const {return m_nbins;}
+
+  /**
+   * @brief Number of bins including underflow and overflow
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nbinsWithFlows() const {return m_nbins + 2;}
+
+  /**
+   * @brief Create an empty histogram with this binning
+   *
+   * @param name
+   * @param title
+   * @return std::unique_ptr<TH1D>
+   */
+  std::unique_ptr<TH1D> emptyHisto(const std::string& name, const std::string& title) const;
+
+private:
+  bool m_regular;
+  std::size_t m_nbins;
+  double m_min;
+  double m_max;
+  std::vector<double> m_edges;
+};
@@ -0,0 +1,83 @@
+/**
+ * @file InputSchemaCache.h
+ * @brief Persistent cache of the information read from the input files while building the graph
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Class that stores lists of strings read from an input file (e.g. branch names or the list of systematics)
+ * in a directory, so that the file does not need to be opened again by the next runs or the other job splits.
+ * An entry is identified by the path of the input file and a name, it is only used if the size
+ * and the modification time of the input file did not change.
+ * Files that are not accessible with std::filesystem (e.g. remote files) are not cached
+ *
+ */
+class InputSchemaCache {
+public:
+
+  /**
+   * @brief Construct a new Input Schema Cache object
+   *
+   * @param directory
+   */
+  explicit InputSchemaCache(const std::string& directory);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  InputSchemaCache() = delete;
+
+  /**
+   * @brief Destroy the Input Schema Cache object
+   *
+   */
+  ~InputSchemaCache() = default;
+
+  /**
+   * @brief Read an entry
+   *
+   * @param path Path of the input file
+   * @param name Name of the entry
+   * @param values Filled with the stored values
+   * @return true if the entry exists and is up to date
+   */
+  bool read(const std::string& path, const std::string& name, std::vector<std::string>& values) const;
+
+  /**
+   * @brief Store an entry, the file is written next to the cache and renamed so that jobs sharing
+   * the directory never read a partial entry
+   *
+   * @param path Path of the input file
+   * @param name Name of the entry
+   * @param values
+   */
+  void write(const std::string& path, const std::string& name, const std::vector<std::string>& values) const;
+
+private:
+
+  /**
+   * @brief Size and modification time of the input file
+   *
+   * @param path
+   * @param stamp
+   * @return true if the file is accessible
+   */
+  static bool stamp(const std::string& path, std::string& stamp);
+
+  /**
+   * @brief Path of the cache file of an entry
+   *
+   * @param path
+   * @param name
+   * @return std::string
+   */
+  std::string entryPath(const std::string& path, const std::string& name) const;
+
+  std::string m_directory;
+};
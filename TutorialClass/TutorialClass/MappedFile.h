@@ -0,0 +1,75 @@
+/**
+ * @file MappedFile.h
+ * @brief Read-only memory mapping of a file
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Read-only memory mapping of a file, the pages are only read when they are accessed
+ *
+ */
+class MappedFile {
+public:
+
+  /**
+   * @brief Map a file, throws if the file cannot be opened
+   *
+   * @param path
+   */
+  explicit MappedFile(const std::string& path);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  MappedFile() = delete;
+
+  /**
+   * @brief Deleted copy constructor
+   *
+   */
+  MappedFile(const MappedFile&) = delete;
+
+  /**
+   * @brief Deleted assignment operator
+   *
+   */
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * @brief Destroy the Mapped File object, unmaps the file
+   *
+   */
+  ~MappedFile();
+
+  /**
+   * @brief Content of the file
+   *
+   * @return const char*
+   */
+  inline const char* data() const {return static_cast<const char*>(m_data);}
+
+  /**
+   * @brief Size of the file in bytes
+   *
+   * @return std::size_t
+   */
+  inline std::size_t size() const {return m_size;}
+
+  /**
+   * @brief Content of the file
+   *
+   * @return std::string_view
+   */
+  inline std::string_view view() const {return std::string_view(this->data(), m_size);}
+
+private:
+  void* m_data;
+  std::size_t m_size;
+};
@@ -0,0 +1,126 @@
+/**
+ * @file MetadataProducer.h
+ * @brief Multithreaded production of the metadata files (file list, sum of weights and entries of the files)
+ *
+ */
+
+#pragma once
+
+#include "TutorialClass/EntryRangeSplitter.h"
+
+#include "FastFrames/UniqueSampleID.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Class that scans directories with ROOT files in parallel and writes the file list
+ * and the sums of weights read by MetadataManager::readFileList and MetadataManager::readSumWeights.
+ * The sample is identified from the "metadata" histogram of each file (bin labels: data type, campaign, DSID),
+ * the sums of weights are the second bin of the "CutBookkeeper_<DSID>_<RUN>_<VARIATION>" histograms,
+ * summed over all files and runs of the UniqueSampleID.
+ * The entries, compressed bytes and cluster starts of the tree of each file are written to the file entries table
+ * read by EntryRangeSplitter, so that the jobs do not open all input files to split their entries
+ *
+ */
+class MetadataProducer {
+public:
+
+  /**
+   * @brief Construct a new Metadata Producer object
+   *
+   * @param nThreads Number of threads reading the files
+   * @param treeName Name of the TTree whose entries are stored
+   */
+  explicit MetadataProducer(const std::size_t nThreads, const std::string& treeName = "reco");
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  MetadataProducer() = delete;
+
+  /**
+   * @brief Destroy the Metadata Producer object
+   *
+   */
+  ~MetadataProducer() = default;
+
+  /**
+   * @brief Find all ROOT files in the directories (recursively) and read their metadata,
+   * each directory is listed and each file is read by one of the threads
+   *
+   * @param directories
+   */
+  void scan(const std::vector<std::string>& directories);
+
+  /**
+   * @brief Write filelist.txt, sum_of_weights.txt and its indexed table sum_of_weights.bin (see SumWeightsTable)
+   * and the file entries table (see EntryRangeSplitter::fileEntriesPath)
+   *
+   * @param outputDirectory
+   */
+  void write(const std::string& outputDirectory) const;
+
+  /**
+   * @brief Number of files read successfully
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nFiles() const {return m_nFiles;}
+
+private:
+
+  /**
+   * @brief Metadata of one file
+   *
+   */
+  struct FileMetadata {
+    bool valid = false;
+    int dsid = 0;
+    std::string campaign;
+    std::string simulation;
+    std::map<std::string, double> sumWeights;
+    EntryRangeSplitter::FileInfo entries;
+  };
+
+  /**
+   * @brief Read the metadata of one file
+   *
+   * @param path
+   * @param treeName
+   * @return FileMetadata
+   */
+  static FileMetadata readFile(const std::string& path, const std::string& treeName);
+
+  /**
+   * @brief Find the ROOT files in a directory, sorted
+   *
+   * @param directory
+   * @return std::vector<std::string>
+   */
+  static std::vector<std::string> findFiles(const std::string& directory);
+
+  std::size_t m_nThreads;
+  std::string m_treeName;
+  std::size_t m_nFiles;
+
+  /**
+   * @brief Sorted paths of the files per UniqueSampleID
+   *
+   */
+  std::map<UniqueSampleID, std::vector<std::string> > m_filePaths;
+
+  /**
+   * @brief Variation | sum of weights, per UniqueSampleID
+   *
+   */
+  std::map<UniqueSampleID, std::map<std::string, double> > m_sumWeights;
+
+  /**
+   * @brief Entries of the tree of the files, in the order of the scan
+   *
+   */
+  std::vector<EntryRangeSplitter::FileInfo> m_fileEntries;
+};
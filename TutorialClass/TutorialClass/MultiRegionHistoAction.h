@@ -0,0 +1,223 @@
+/**
+ * @file MultiRegionHistoAction.h
+ * @brief RDataFrame action filling one variable into the histograms of all regions passed by the event
+ *
+ */
+
+#pragma once
+
+#include "TutorialClass/FlatHistoAction.h"
+#include "TutorialClass/HistoAxis.h"
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include "TROOT.h"
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class TTreeReader;
+
+/**
+ * @brief Result of the MultiRegionHistoAction, one flat histogram per region
+ *
+ */
+class MultiRegionHistoResult {
+public:
+
+  /**
+   * @brief Construct a new Multi Region Histo Result object
+   *
+   * @param axes Binning per region
+   */
+  explicit MultiRegionHistoResult(const std::vector<HistoAxis>& axes);
+
+  /**
+   * @brief Destroy the Multi Region Histo Result object
+   *
+   */
+  ~MultiRegionHistoResult() = default;
+
+  /**
+   * @brief Number of regions
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nRegions() const {return m_regions.size();}
+
+  /**
+   * @brief Get the histogram of a region
+   *
+   * @param region Position of the region in the list given to the action
+   * @return FlatHistoResult&
+   */
+  inline FlatHistoResult& region(const std::size_t region) {return m_regions.at(region);}
+
+  /**
+   * @brief Get the histogram of a region
+   *
+   * @param region Position of the region in the list given to the action
+   * @return const FlatHistoResult&
+   */
+  inline const FlatHistoResult& region(const std::size_t region) const {return m_regions.at(region);}
+
+private:
+  std::vector<FlatHistoResult> m_regions;
+};
+
+/**
+ * @brief Custom RDataFrame action that reads a variable once and fills it into the histograms
+ * of all regions whose bit is set in the region bitmask of the event.
+ * The columns are the variable (scalar or container), the weight and the region bitmask
+ *
+ * @tparam T Type of the variable column
+ */
+template<typename T>
+class MultiRegionHistoAction : public ROOT::Detail::RDF::RActionImpl<MultiRegionHistoAction<T> > {
+public:
+
+  using Result_t = MultiRegionHistoResult;
+
+  /**
+   * @brief Construct a new Multi Region Histo Action object
+   *
+   * @param axes Binning per region
+   * @param bits Bit of each region in the region bitmask
+   */
+  explicit MultiRegionHistoAction(const std::vector<HistoAxis>& axes, const std::vector<std::size_t>& bits) :
+    m_result(std::make_shared<Result_t>(axes)),
+    m_bits(0),
+    m_nSlots(ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : 1)
+  {
+    if (axes.size() != bits.size()) {
+      throw std::invalid_argument("MultiRegionHistoAction: number of axes does not match the number of regions");
+    }
+    m_regionOfBit.fill(-1);
+    for (std::size_t i = 0; i < bits.size(); ++i) {
+      if (bits.at(i) >= 64) {
+        throw std::invalid_argument("MultiRegionHistoAction: only 64 regions are supported");
+      }
+      m_bits |= 1ull << bits.at(i);
+      m_regionOfBit.at(bits.at(i)) = static_cast<int>(i);
+    }
+    m_sumW.resize(m_nSlots*axes.size());
+    m_sumW2.resize(m_nSlots*axes.size());
+    m_stats.resize(m_nSlots*axes.size(), FlatHistoResult::Stats{});
+    m_entries.resize(m_nSlots*axes.size(), 0.);
+  }
+
+  /**
+   * @brief Deleted copy constructor
+   *
+   */
+  MultiRegionHistoAction(const MultiRegionHistoAction&) = delete;
+
+  /**
+   * @brief Default move constructor
+   *
+   */
+  MultiRegionHistoAction(MultiRegionHistoAction&&) = default;
+
+  /**
+   * @brief Destroy the Multi Region Histo Action object
+   *
+   */
+  ~MultiRegionHistoAction() = default;
+
+  /**
+   * @brief Get the result (needed by RDataFrame)
+   *
+   * @return std::shared_ptr<Result_t>
+   */
+  std::shared_ptr<Result_t> GetResultPtr() const {return m_result;}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void Initialize() {}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void InitTask(TTreeReader*, unsigned int) {}
+
+  /**
+   * @brief Fill the value into all passed regions
+   *
+   * @param slot
+   * @param value
+   * @param weight
+   * @param mask Region bitmask of the event
+   */
+  void Exec(unsigned int slot, const T& value, const double weight, const ULong64_t mask) {
+    ULong64_t bits = mask & m_bits;
+    if (bits == 0) return;
+
+    const std::size_t n = FlatHistoDetail::fillSize(value);
+    for (std::size_t ibit = 0; bits != 0; ++ibit, bits >>= 1) {
+      if ((bits & 1) == 0) continue;
+
+      const std::size_t region = m_regionOfBit[ibit];
+      const FlatHistoResult& result = m_result->region(region);
+      const std::size_t index = slot*m_result->nRegions() + region;
+      std::vector<double>& sumW  = m_sumW[index];
+      std::vector<double>& sumW2 = m_sumW2[index];
+      if (sumW.empty()) {
+        sumW.resize(result.nCells(), 0.);
+        sumW2.resize(result.nCells(), 0.);
+      }
+
+      for (std::size_t i = 0; i < n; ++i) {
+        const double point[] = {FlatHistoDetail::valueAt(value, i)};
+        result.fillPoint(sumW.data(), sumW2.data(), m_stats[index], point, weight);
+      }
+      m_entries[index] += n;
+    }
+  }
+
+  /**
+   * @brief Merge the per-slot content into the result
+   *
+   */
+  void Finalize() {
+    for (std::size_t islot = 0; islot < m_nSlots; ++islot) {
+      for (std::size_t iregion = 0; iregion < m_result->nRegions(); ++iregion) {
+        const std::size_t index = islot*m_result->nRegions() + iregion;
+        if (m_sumW.at(index).empty()) continue;
+        m_result->region(iregion).add(m_sumW.at(index), m_sumW2.at(index), m_stats.at(index), m_entries.at(index));
+      }
+    }
+  }
+
+  /**
+   * @brief Name of the action
+   *
+   * @return std::string
+   */
+  std::string GetActionName() const {return "MultiRegionHisto";}
+
+private:
+  std::shared_ptr<Result_t> m_result;
+  ULong64_t m_bits;
+  std::size_t m_nSlots;
+
+  /**
+   * @brief Position of the region for each bit of the mask, -1 if the region is not filled
+   *
+   */
+  std::array<int, 64> m_regionOfBit;
+
+  /**
+   * @brief per slot and region content [slot x region], empty until filled
+   *
+   */
+  std::vector<std::vector<double> > m_sumW;
+  std::vector<std::vector<double> > m_sumW2;
+  std::vector<FlatHistoResult::Stats> m_stats;
+  std::vector<double> m_entries;
+};
@@ -0,0 +1,99 @@
+/**
+ * @file NormalisationTable.h
+ * @brief Normalisations of all UniqueSampleIDs and sum of weights variations
+ *
+ */
+
+#pragma once
+
+#include "FastFrames/UniqueSampleID.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ConfigSetting;
+class MetadataManager;
+
+/**
+ * @brief Dense table of the normalisations (luminosity * cross-section/sumWeights), built once from the metadata.
+ * The normalisation only depends on the UniqueSampleID and on the sum of weights variation of the systematic,
+ * the values of one variation are contiguous and indexed by the integer ID of the UniqueSampleID
+ *
+ */
+class NormalisationTable {
+public:
+
+  /**
+   * @brief Construct a new Normalisation Table object for all samples and systematics of the config
+   *
+   * @param config
+   * @param metadataManager Initialised metadata
+   */
+  explicit NormalisationTable(const ConfigSetting& config, const MetadataManager& metadataManager);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  NormalisationTable() = delete;
+
+  /**
+   * @brief Destroy the Normalisation Table object
+   *
+   */
+  ~NormalisationTable() = default;
+
+  /**
+   * @brief Integer ID of a UniqueSampleID, throws if it is not known
+   *
+   * @param id
+   * @return std::size_t
+   */
+  std::size_t sampleIndex(const UniqueSampleID& id) const;
+
+  /**
+   * @brief Integer ID of a sum of weights variation, throws if it is not known
+   *
+   * @param sumWeights
+   * @return std::size_t
+   */
+  std::size_t variationIndex(const std::string& sumWeights) const;
+
+  /**
+   * @brief Normalisations of a variation, indexed by the sample ID.
+   * Combinations not used by any sample are NaN
+   *
+   * @param variation
+   * @return const double*
+   */
+  inline const double* variation(const std::size_t variation) const {return m_values.data() + variation*m_ids.size();}
+
+  /**
+   * @brief Normalisation of a sample for a variation
+   *
+   * @param sample
+   * @param variation
+   * @return double
+   */
+  inline double value(const std::size_t sample, const std::size_t variation) const {return this->variation(variation)[sample];}
+
+  /**
+   * @brief Number of UniqueSampleIDs
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nSamples() const {return m_ids.size();}
+
+  /**
+   * @brief Number of sum of weights variations
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nVariations() const {return m_variations.size();}
+
+private:
+  std::vector<UniqueSampleID> m_ids;
+  std::vector<std::string> m_variations;
+  std::vector<double> m_values;
+};
@@ -0,0 +1,833 @@
+/**
+ * @file SampleGraph.h
+ * @brief Processing of all UniqueSampleIDs of a Sample within a single RDataFrame graph
+ *
+ */
+
+#pragma once
+
+#include "FastFrames/ConfigSetting.h"
+#include "FastFrames/HistoContainer.h"
+#include "FastFrames/MetadataManager.h"
+#include "FastFrames/SystematicReplacer.h"
+
+#include "TutorialClass/FlatHistoAction.h"
+#include "TutorialClass/FormulaCompiler.h"
+#include "TutorialClass/InputSchemaCache.h"
+#include "TutorialClass/MultiRegionHistoAction.h"
+#include "TutorialClass/NormalisationTable.h"
+#include "TutorialClass/SystematicBatch.h"
+#include "TutorialClass/SystematicBranchMatcher.h"
+#include "TutorialClass/SystematicHistoAction.h"
+#include "TutorialClass/SystematicIndex.h"
+#include "TutorialClass/WeightVariationHistoAction.h"
+
+#include "ROOT/RDataFrame.hxx"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <regex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+class MainFrame;
+class Region;
+class Sample;
+class Systematic;
+class Variable;
+enum class VariableType;
+
+/**
+ * @brief Histogram of one systematic in one region booked with FlatHistoAction.
+ * One variable name for 1D, two for 2D and three for 3D histograms
+ *
+ */
+struct FlatHisto {
+  std::shared_ptr<Systematic> systematic;
+  std::shared_ptr<Region> region;
+  std::vector<std::string> variableNames;
+  ROOT::RDF::RResultPtr<FlatHistoResult> result;
+};
+
+/**
+ * @brief Histograms of one variable and one systematic in several regions, booked with MultiRegionHistoAction
+ *
+ */
+struct MultiRegionHisto {
+  std::shared_ptr<Systematic> systematic;
+  std::vector<std::shared_ptr<Region> > regions;
+  std::string variableName;
+  ROOT::RDF::RResultPtr<MultiRegionHistoResult> result;
+};
+
+/**
+ * @brief Histograms of one variable in one region for systematics that only differ by their weight,
+ * booked with WeightVariationHistoAction
+ *
+ */
+struct WeightVariationHisto {
+  std::shared_ptr<Region> region;
+  std::string variableName;
+  std::vector<std::shared_ptr<Systematic> > systematics;
+  std::vector<std::size_t> variations;
+  ROOT::RDF::RResultPtr<SystematicHistoResult> result;
+};
+
+/**
+ * @brief Histograms already booked, key = SampleGraph::histoIdentity.
+ * Systematics that change neither the selection nor the filled columns reuse them
+ *
+ */
+struct BookedHistos {
+  std::map<std::string, ROOT::RDF::RResultPtr<TH1D> > histos1D;
+  std::map<std::string, ROOT::RDF::RResultPtr<TH2D> > histos2D;
+  std::map<std::string, ROOT::RDF::RResultPtr<TH3D> > histos3D;
+  std::map<std::string, ROOT::RDF::RResultPtr<FlatHistoResult> > flat;
+  std::map<std::string, ROOT::RDF::RResultPtr<MultiRegionHistoResult> > multiRegion;
+};
+
+/**
+ * @brief Summary of the graph built for a Sample, reported by the dry run
+ *
+ */
+struct GraphPlan {
+  std::size_t defines = 0;
+  std::size_t regionDefines = 0; ///< distinct column names defined after the region filters
+  std::size_t filters = 0;
+  std::size_t actions = 0;
+  std::vector<std::string> jitFormulas;
+};
+
+/**
+ * @brief Histograms of one variable in one region for all systematics, booked with SystematicHistoAction
+ *
+ */
+struct VectorisedHisto {
+  std::shared_ptr<Region> region;
+  std::string variableName;
+  ROOT::RDF::RResultPtr<SystematicHistoResult> result;
+};
+
+/**
+ * @brief Filtered nodes per region, per systematic. Skipped systematic and region combinations have no node
+ *
+ */
+using RegionFilters = std::vector<std::vector<std::optional<ROOT::RDF::RNode> > >;
+
+/**
+ * @brief Class that builds the histogramming graph once per Sample.
+ * The input is the dataset specification from MetadataManager::dataSpec that
+ * contains the files of all UniqueSampleIDs, the normalisation is switched per
+ * UniqueSampleID using the sample information of RDataFrame.
+ * This way the JIT compilation is paid once per Sample and not once per UniqueSampleID.
+ * NOTE: The user's defineVariables() and defineVariablesRegion() are called only once and receive the first
+ * UniqueSampleID of the Sample. Samples with several UniqueSampleIDs are therefore only processed this way
+ * when the custom option "id_independent_defines" declares that the defines do not depend on the UniqueSampleID.
+ *
+ */
+class SampleGraph {
+public:
+
+  /**
+   * @brief Construct a new Sample Graph object
+   *
+   * @param frame The frame providing the user defines (defineVariables, ...)
+   * @param config The config
+   * @param metadataManager Metadata of all the samples
+   * @param normalisations Normalisations of all the samples
+   * @param systReplacer Systematic replacer of the frame, shared with systematicDefine
+   * @param batchedColumns Batched defines of the frame whose single variations are defined when the graph reads them,
+   * can be nullptr
+   */
+  explicit SampleGraph(MainFrame& frame,
+                       const std::shared_ptr<ConfigSetting>& config,
+                       const MetadataManager& metadataManager,
+                       const NormalisationTable& normalisations,
+                       SystematicReplacer& systReplacer,
+                       const BatchedColumns* batchedColumns = nullptr) noexcept;
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  SampleGraph() = delete;
+
+  /**
+   * @brief Destroy the Sample Graph object
+   *
+   */
+  ~SampleGraph() = default;
+
+  /**
+   * @brief Key of the RSample metadata holding the position of the UniqueSampleID in the Sample
+   *
+   */
+  static constexpr const char* sampleIndexKey = "unique_sample_index";
+
+  /**
+   * @brief Can the Sample be processed with a single graph?
+   * Truth trees, cutflows, ONNX inference and event ranges of Samples with several UniqueSampleIDs
+   * are only supported by the standard per UniqueSampleID processing, as well as Samples with several
+   * UniqueSampleIDs unless the custom option "id_independent_defines" is set
+   *
+   * @param sample
+   * @param config
+   * @return true
+   * @return false
+   */
+  static bool isSupported(const std::shared_ptr<Sample>& sample,
+                          const std::shared_ptr<ConfigSetting>& config);
+
+  /**
+   * @brief Build the graph for all UniqueSampleIDs, run the event loop and write the histograms
+   *
+   * @param sample
+   */
+  void processSample(const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Estimate the memory needed by the histograms of one systematic, summed over all slots
+   *
+   * @param sample
+   * @param systematic
+   * @return std::size_t Bytes
+   */
+  std::size_t histogramMemory(const std::shared_ptr<Sample>& sample,
+                              const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Memory of the histogram buffers, summed over all slots
+   *
+   * @param cells Number of cells (including underflow and overflow) of all histograms
+   * @param histos Number of histograms
+   * @param nSlots
+   * @param nSamples Number of UniqueSampleIDs whose flat content without normalisation is kept (unnormalised_histograms), 0 otherwise
+   * @param flat Histograms stored with FlatHistoAction
+   * @return std::size_t Bytes
+   */
+  static std::size_t histogramBytes(const std::size_t cells,
+                                    const std::size_t histos,
+                                    const std::size_t nSlots,
+                                    const std::size_t nSamples,
+                                    const bool flat);
+
+  /**
+   * @brief Split a selection into the terms of its top-level conjunction,
+   * e.g. "(a && b) && c" gives {"a", "b", "c"}. The order of the terms is kept
+   * so that the terms guarding later terms (e.g. on a vector size) are still evaluated first.
+   * Selections with a top-level "||", "?:" or "," are not plain conjunctions and give one term
+   *
+   * @param selection
+   * @return std::vector<std::string>
+   */
+  static std::vector<std::string> selectionTerms(const std::string& selection);
+
+  /**
+   * @brief Split a weight into the factors of its top-level product,
+   * e.g. "(a*b)*c" gives {"a", "b", "c"}. Weights that are not plain products give one factor
+   *
+   * @param weight
+   * @return std::vector<std::string>
+   */
+  static std::vector<std::string> weightFactors(const std::string& weight);
+
+  /**
+   * @brief Check whether a formula reads one of the columns, i.e. contains it as an identifier token
+   *
+   * @param formula
+   * @param columns
+   * @return bool
+   */
+  static bool readsColumn(const std::string& formula, const std::set<std::string>& columns);
+
+  /**
+   * @brief Parse the groups of "aggregated_weight_variations": comma separated "<group>:<regex>",
+   * the regex has to match the whole systematic name
+   *
+   * @param option
+   * @return std::vector<std::pair<std::string, std::regex> > (group, regex)
+   */
+  static std::vector<std::pair<std::string, std::regex> > aggregationGroups(const std::string& option);
+
+  /**
+   * @brief Group of a systematic name
+   *
+   * @param systematic Name of the systematic
+   * @param groups (group, regex) from aggregationGroups
+   * @return std::string The first group whose regex matches the whole name, empty if none matches
+   */
+  static std::string aggregationGroup(const std::string& systematic,
+                                      const std::vector<std::pair<std::string, std::regex> >& groups);
+
+private:
+
+  /**
+   * @brief Build the graph for a batch of systematics of the Sample, run the event loop and write the histograms
+   *
+   * @param sample
+   * @param spec Dataset of the job, see dataSpec
+   * @param systematics Systematics of the batch, the Sample is not modified
+   * @param recreate Recreate the output file, otherwise the histograms are added to it
+   */
+  void processBatch(const std::shared_ptr<Sample>& sample,
+                    const ROOT::RDF::Experimental::RDatasetSpec& spec,
+                    const std::vector<std::shared_ptr<Systematic> >& systematics,
+                    const bool recreate);
+
+  /**
+   * @brief Dataset specification of the Sample, one RSample per UniqueSampleID with its position in the Sample
+   * in the metadata (key sampleIndexKey). The files of the job are selected per UniqueSampleID as in MetadataManager::dataSpec,
+   * an event range in the config is applied to them as the global entry range of the dataset, so the event loop keeps
+   * the implicit multithreading that RDF Range disables. With the custom option "balanced_job_splitting" the entries
+   * of all files (within the event range) are split between the jobs instead (see EntryRangeSplitter)
+   *
+   * @param sample
+   * @param inputs Filled with the files of the job and the fraction of their entries it processes
+   * @return std::optional<ROOT::RDF::Experimental::RDatasetSpec> Empty if the job has no files or no entries of the Sample
+   */
+  std::optional<ROOT::RDF::Experimental::RDatasetSpec> dataSpec(const std::shared_ptr<Sample>& sample,
+                                                                std::vector<std::pair<std::string, double> >& inputs) const;
+
+  /**
+   * @brief Print the size of the graph, the expressions compiled with JIT, the estimated histogram memory
+   * and the size of the input read by the job, used by the dry run (custom option "dry_run")
+   *
+   * @param sample
+   */
+  void printPlan(const std::shared_ptr<Sample>& sample) const;
+
+  /**
+   * @brief Split the systematics into batches whose histograms fit the memory budget
+   * (custom option "histogram_memory_budget_mb"), each batch is processed with its own event loop
+   *
+   * @param sample
+   * @return std::vector<std::vector<std::shared_ptr<Systematic> > > A single batch when no budget is set
+   */
+  std::vector<std::vector<std::shared_ptr<Systematic> > > systematicBatches(const std::shared_ptr<Sample>& sample) const;
+
+  /**
+   * @brief Same as SystematicReplacer::readSystematicMapFromFile, but the branches are first classified
+   * by SystematicBranchMatcher and only the branches affected by systematics are matched.
+   * The result is cached per input schema (branches and systematics), the branch names are read
+   * from the InputSchemaCache when it is used
+   *
+   * @param path Path to the ROOT file
+   * @param sample
+   * @return SystematicReplacer
+   */
+  SystematicReplacer readSystematicMap(const std::string& path,
+                                       const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Add systematics from the listOfSystematics histogram of the first input file
+   *
+   * @param sample
+   */
+  void readAutomaticSystematics(const std::shared_ptr<Sample>& sample) const;
+
+  /**
+   * @brief Add the "sample_index_fastframes" column, the position of the UniqueSampleID in the Sample
+   * read from the metadata of the RSample. The value is updated every time a new input file is opened
+   *
+   * @param node
+   * @param sample
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode addNormalisation(ROOT::RDF::RNode node,
+                                    const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Adds ROOT::Math::PtEtaPhiEVector for objects requested in the config
+   *
+   * @param node
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode addTLorentzVectors(ROOT::RDF::RNode node);
+
+  /**
+   * @brief Add custom columns from the config and the user class
+   *
+   * @param node
+   * @param sample
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode addCustomDefines(ROOT::RDF::RNode node,
+                                    const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Define the columns of the single variations of the batched defines that the graph reads:
+   * those in the selections, weights and variables of the processed systematics, and all variations
+   * of the batched columns read by the config defines and the variables with formula
+   *
+   * @param node
+   * @param sample
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode addBatchedVariations(ROOT::RDF::RNode node,
+                                    const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Define a column and its systematic copies from a formula, same as MainFrame::systematicStringDefine
+   * but using the compiled formulas when enabled
+   *
+   * @param node
+   * @param name Name of the new column, has to contain "NOSYS"
+   * @param formula The formula (using nominal columns)
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode stringDefine(ROOT::RDF::RNode node,
+                                const std::string& name,
+                                const std::string& formula);
+
+  /**
+   * @brief Define a column from a formula, using the compiled formulas when enabled
+   *
+   * @param node
+   * @param name
+   * @param formula
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode jitDefine(ROOT::RDF::RNode node,
+                             const std::string& name,
+                             const std::string& formula) const;
+
+  /**
+   * @brief Apply a filter from a formula, using the compiled formulas when enabled
+   *
+   * @param node
+   * @param formula
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode jitFilter(ROOT::RDF::RNode node,
+                             const std::string& formula) const;
+
+  /**
+   * @brief Add "weight_total_<SYSTEMATIC>" columns, the weight formula multiplied by the normalisation
+   * read from the NormalisationTable by a typed Define.
+   * The weights are split into factors, the distinct factors of all systematics are evaluated once per event
+   * and packed into one column backed by per slot buffers ("weight_factors_fastframes"), the weights of all systematics are their products ("weights_fastframes").
+   * Systematics with the same weight factors and normalisations as a previous systematic reuse its column
+   *
+   * @param node
+   * @param sample
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode addWeightColumns(ROOT::RDF::RNode node,
+                                    const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Apply the region selections
+   * The selections are split into the terms of their conjunctions, selections starting
+   * with the same terms (in any region or systematic) share the filters of these terms.
+   * When vectorised systematics are used, one column with the decisions for all systematics
+   * is added per region (packed by typed Defines from one column per distinct selection)
+   * and the per systematic filters only read this column.
+   * When region bitmasks are used, the per region filters only test a bit of the mask of the systematic
+   *
+   * @param node
+   * @param sample
+   * @return RegionFilters Filter stored per region, per systematic
+   */
+  RegionFilters applyFilters(ROOT::RDF::RNode node,
+                             const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Add per systematic a column with the bitmask of the regions the event passes
+   * (bit i = i-th region of the Sample), all selections are evaluated in one function.
+   * The nodes keep only events passing at least one region
+   *
+   * @param node
+   * @param sample
+   */
+  void addRegionMasks(ROOT::RDF::RNode node,
+                      const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Get name of the region bitmask column for a systematic
+   *
+   * @param systematic
+   * @return std::string
+   */
+  std::string regionMaskColumn(const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Decide which variables are filled with SystematicHistoAction:
+   * scalar variables that are not nominal only and that do not read defined columns
+   * differing between the systematics. Nothing is vectorised when a weight factor differing
+   * between the systematics indexes or reads a defined column
+   *
+   * @param node
+   * @param sample
+   */
+  void selectVectorisedVariables(ROOT::RDF::RNode node,
+                                 const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Add the packed columns with the values of all systematics needed by SystematicHistoAction.
+   * The distinct columns are read by typed Defines writing to preallocated per slot buffers,
+   * variables of unsupported types are removed from the vectorised variables
+   *
+   * @param node
+   * @param sample
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode addVectorisedColumns(ROOT::RDF::RNode node,
+                                        const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Book SystematicHistoAction for the vectorised variables, one per region and variable
+   *
+   * @param sample
+   * @return std::vector<VectorisedHisto>
+   */
+  std::vector<VectorisedHisto> bookVectorisedHistograms(const std::shared_ptr<Sample>& sample);
+
+  /**
+   * @brief Book all histograms, does not trigger the event loop
+   *
+   * @param filters Filter stored per region, per systematic
+   * @param flatHistos Histograms booked with FlatHistoAction, only filled when flat histograms are used
+   * @param multiRegionHistos Histograms booked with MultiRegionHistoAction, only filled when region bitmasks are used
+   * @param weightVariationHistos Histograms booked with WeightVariationHistoAction, only filled when bulk weight variations are used
+   * @param sample
+   * @return std::vector<SystematicHisto> Histograms booked with Histo1D/2D/3D
+   */
+  std::vector<SystematicHisto> bookHistograms(RegionFilters& filters,
+                                              std::vector<FlatHisto>& flatHistos,
+                                              std::vector<MultiRegionHisto>& multiRegionHistos,
+                                              std::vector<WeightVariationHisto>& weightVariationHistos,
+                                              const std::shared_ptr<Sample>& sample) const;
+
+  /**
+   * @brief Book WeightVariationHistoAction for the 1D variables of the systematics that share the selection
+   * and the filled column but not the weight (e.g. generator weights). The variable is read once and all
+   * weights are taken from the vector of the weights of all systematics
+   *
+   * @param filters Filter stored per region, per systematic
+   * @param sample
+   * @param weightVariationHistos The booked histograms are added here
+   * @return std::set<std::tuple<std::size_t, std::size_t, std::string> > Systematic index | region index | variable name of the booked histograms
+   */
+  std::set<std::tuple<std::size_t, std::size_t, std::string> > bookWeightVariationHistos(RegionFilters& filters,
+                                                                                         const std::shared_ptr<Sample>& sample,
+                                                                                         std::vector<WeightVariationHisto>& weightVariationHistos) const;
+
+  /**
+   * @brief Book MultiRegionHistoAction for the 1D variables of a systematic filled in more than one region
+   * with the same definition, the variable is read once and filled in all regions passed by the event
+   *
+   * @param sample
+   * @param isyst Position of the systematic in the Sample
+   * @param booked Histograms already booked for other systematics
+   * @param multiRegionHistos The booked histograms are added here
+   * @return std::set<std::pair<std::size_t, std::string> > Region index | variable name of the booked histograms
+   */
+  std::set<std::pair<std::size_t, std::string> > bookMultiRegionHistos(const std::shared_ptr<Sample>& sample,
+                                                                       const std::size_t isyst,
+                                                                       BookedHistos& booked,
+                                                                       std::vector<MultiRegionHisto>& multiRegionHistos) const;
+
+  /**
+   * @brief Book a histogram with FlatHistoAction
+   *
+   * @param node Filtered node, the columns converted to double are added to it for 2D and 3D histograms
+   * @param region
+   * @param variableNames One name per dimension
+   * @param systematic
+   * @param flatHistos The booked histogram is added here
+   * @return true Histogram booked
+   * @return false Type of a column is not supported, use Histo1D/2D/3D instead
+   */
+  bool bookFlatHisto(ROOT::RDF::RNode& node,
+                     const std::shared_ptr<Region>& region,
+                     const std::vector<std::string>& variableNames,
+                     const std::shared_ptr<Systematic>& systematic,
+                     std::vector<FlatHisto>& flatHistos) const;
+
+  /**
+   * @brief Add a column with the variable converted to double (scalars) or ROOT::RVec<double> (containers)
+   *
+   * @param node
+   * @param variable
+   * @param systematic
+   * @param scalar Set to true when the converted column is a scalar
+   * @return true
+   * @return false Type of the column is not supported
+   */
+  bool addFlatColumn(ROOT::RDF::RNode& node,
+                     const Variable& variable,
+                     const std::shared_ptr<Systematic>& systematic,
+                     bool& scalar) const;
+
+  /**
+   * @brief Get the type of the variable, from the config when set, otherwise from RDataFrame
+   *
+   * @param node
+   * @param variable
+   * @param column
+   * @return VariableType UNDEFINED when the type is not supported
+   */
+  VariableType columnType(ROOT::RDF::RNode node,
+                          const Variable& variable,
+                          const std::string& column) const;
+
+  /**
+   * @brief Book 1D histogram with proper templates
+   *
+   * @param node
+   * @param variable
+   * @param systematic
+   * @return ROOT::RDF::RResultPtr<TH1D>
+   */
+  ROOT::RDF::RResultPtr<TH1D> book1Dhisto(ROOT::RDF::RNode node,
+                                          const Variable& variable,
+                                          const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Write the histograms to the output ROOT file
+   * The flat, multi-region, vectorised and weight variation histograms are converted to TH1D/TH2D/TH3D here
+   *
+   * @param histos
+   * @param flatHistos
+   * @param multiRegionHistos
+   * @param vectorisedHistos
+   * @param weightVariationHistos
+   * @param sample
+   * @param recreate Recreate the output file, otherwise the histograms are added to it
+   */
+  void writeHistosToFile(const std::vector<SystematicHisto>& histos,
+                         const std::vector<FlatHisto>& flatHistos,
+                         const std::vector<MultiRegionHisto>& multiRegionHistos,
+                         const std::vector<VectorisedHisto>& vectorisedHistos,
+                         const std::vector<WeightVariationHisto>& weightVariationHistos,
+                         const std::shared_ptr<Sample>& sample,
+                         const bool recreate) const;
+
+  /**
+   * @brief Group of a systematic in "aggregated_weight_variations"
+   *
+   * @param systematic
+   * @return std::string The group, empty if the systematic is not aggregated
+   */
+  std::string aggregationGroup(const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Get the selection after applying the systematic replacements
+   *
+   * @param sample
+   * @param systematic
+   * @param region
+   * @return std::string
+   */
+  std::string systematicFilter(const std::shared_ptr<Sample>& sample,
+                               const std::shared_ptr<Systematic>& systematic,
+                               const std::shared_ptr<Region>& region) const;
+
+  /**
+   * @brief Get name of a variable after applying the systematic replacements
+   *
+   * @param variable
+   * @param systematic
+   * @return std::string
+   */
+  std::string systematicVariable(const Variable& variable,
+                                 const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Get name of the weight column for a systematic
+   *
+   * @param systematic
+   * @return std::string
+   */
+  std::string systematicWeight(const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Replace the nominal columns in a formula by the columns of a systematic,
+   * cached by SystematicIndex
+   *
+   * @param original
+   * @param systematic
+   * @return std::string
+   */
+  std::string replaceString(const std::string& original,
+                            const std::shared_ptr<Systematic>& systematic) const;
+
+  /**
+   * @brief Get the column holding the same values as the column, the column itself if it is not a copy
+   *
+   * @param column
+   * @return std::string
+   */
+  std::string identicalColumn(const std::string& column) const;
+
+  /**
+   * @brief Key of a histogram, histograms with the same key have the same content:
+   * region, selection after the systematic replacement and filled columns (including the weight)
+   *
+   * @param sample
+   * @param systematic
+   * @param region
+   * @param columns
+   * @return std::string
+   */
+  std::string histoIdentity(const std::shared_ptr<Sample>& sample,
+                            const std::shared_ptr<Systematic>& systematic,
+                            const std::shared_ptr<Region>& region,
+                            const std::vector<std::string>& columns) const;
+
+  /**
+   * @brief Get path of the output file for the Sample
+   *
+   * @param sample
+   * @return std::string
+   */
+  std::string outputFileName(const std::shared_ptr<Sample>& sample) const;
+
+  MainFrame& m_frame;
+  std::shared_ptr<ConfigSetting> m_config;
+  const MetadataManager& m_metadataManager;
+  const NormalisationTable& m_normalisations;
+  SystematicReplacer& m_systReplacer;
+  const BatchedColumns* m_batchedColumns;
+
+  /**
+   * @brief Systematics of the batch being processed, used instead of Sample::systematics()
+   *
+   */
+  std::vector<std::shared_ptr<Systematic> > m_systematics;
+
+  /**
+   * @brief Cache of the systematic replacements of the Sample being processed
+   *
+   */
+  std::unique_ptr<SystematicIndex> m_systIndex;
+
+  /**
+   * @brief Systematic maps per input schema, key = SystematicBranchMatcher::schemaHash
+   *
+   */
+  std::map<std::uint64_t, SystematicReplacer> m_replacerCache;
+
+  /**
+   * @brief Branch names and lists of systematics of the input files (custom option "schema_cache_directory"),
+   * nullptr when the files are always opened
+   *
+   */
+  std::unique_ptr<InputSchemaCache> m_schemaCache;
+
+  /**
+   * @brief Variables defined with a formula, key = formula, value = new column name
+   *
+   */
+  std::map<std::string, std::string> m_variablesWithFormula;
+
+  /**
+   * @brief Per systematic columns (normalisation, weight, region bitmask) that are not defined
+   * because they would be a copy of another column, key = column, value = column with the same values
+   *
+   */
+  std::map<std::string, std::string> m_columnIdentity;
+
+  /**
+   * @brief Store histograms in flat buffers (FlatHistoAction) instead of per slot TH1D/TH2D/TH3D
+   *
+   */
+  bool m_flat = false;
+
+  /**
+   * @brief Fill the flat histograms with the weight without normalisation, the content of each slot is scaled
+   * by the normalisation of its UniqueSampleID when the slot moves to the next UniqueSampleID
+   *
+   */
+  bool m_postFillNormalisation = false;
+
+  /**
+   * @brief Also write the flat histograms without normalisation of each UniqueSampleID (post-fill normalisation only)
+   *
+   */
+  bool m_unnormalisedHistos = false;
+
+  /**
+   * @brief Systematic name | (column of the weight without normalisation, normalisation per UniqueSampleID of the Sample)
+   *
+   */
+  std::map<std::string, std::pair<std::string, std::vector<double> > > m_unnormalisedWeights;
+
+  /**
+   * @brief Compiled formulas (custom option "aot_formulas"), nullptr when the formulas are JIT compiled
+   *
+   */
+  std::unique_ptr<FormulaCompiler> m_compiler;
+
+  /**
+   * @brief Build the graph and print the plan, without running the event loop
+   *
+   */
+  bool m_dryRun = false;
+
+  /**
+   * @brief Bookkeeping of the graph being built, only used for the dry run
+   *
+   */
+  mutable GraphPlan m_plan;
+
+  /**
+   * @brief Input files of the job for the current Sample and the fraction of their entries it processes, see dataSpec
+   *
+   */
+  std::vector<std::pair<std::string, double> > m_jobInputs;
+
+  /**
+   * @brief Evaluate all region selections of a systematic in one column (custom option "region_bitmask")
+   *
+   */
+  bool m_regionMask = false;
+
+  /**
+   * @brief Per systematic node with the region bitmask column, only with events passing at least one region
+   *
+   */
+  std::vector<ROOT::RDF::RNode> m_maskNodes;
+
+  /**
+   * @brief Fill all systematics of scalar variables with SystematicHistoAction
+   *
+   */
+  bool m_vectorised = false;
+
+  /**
+   * @brief Fill the systematics that only change the weight with WeightVariationHistoAction (custom option "bulk_weight_variations")
+   *
+   */
+  bool m_bulkWeights = false;
+
+  /**
+   * @brief (group, regex of the systematic names) whose weight variations are only written as aggregates
+   * (custom option "aggregated_weight_variations"), e.g. the members of a PDF set
+   *
+   */
+  std::vector<std::pair<std::string, std::regex> > m_aggregatedGroups;
+
+  /**
+   * @brief Definitions of the variables filled with SystematicHistoAction
+   *
+   */
+  std::set<std::string> m_vectorisedVariables;
+
+  /**
+   * @brief Variable definition | packed column with its values for all systematics
+   *
+   */
+  std::map<std::string, std::string> m_packedValues;
+
+  /**
+   * @brief Per region node that passes the selection for at least one systematic
+   *
+   */
+  std::vector<ROOT::RDF::RNode> m_regionNodes;
+};
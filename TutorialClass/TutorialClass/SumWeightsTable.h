@@ -0,0 +1,164 @@
+/**
+ * @file SumWeightsTable.h
+ * @brief Indexed binary table of the sums of weights
+ *
+ */
+
+#pragma once
+
+#include "FastFrames/UniqueSampleID.h"
+
+#include "TutorialClass/MappedFile.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Memory-mapped table of the sums of weights, sorted by "<DSID> <CAMPAIGN> <SIMULATION> <VARIATION>".
+ * Only the pages with the requested UniqueSampleIDs are read, the cost of a lookup does not depend on the
+ * size of the production. The file is written next to sum_of_weights.txt (same name, extension .bin).
+ * Layout: "FFSUMW02", fingerprint of the sum_of_weights.txt it was produced from (size, modification time, hash),
+ * number of entries, entries (key offset, key length, value) and the keys
+ *
+ */
+class SumWeightsTable {
+public:
+
+  /**
+   * @brief Variation | sum of weights, per UniqueSampleID
+   *
+   */
+  using Entries = std::map<UniqueSampleID, std::map<std::string, double> >;
+
+  /**
+   * @brief Open and map a table, throws if the file is not a table
+   *
+   * @param path
+   */
+  explicit SumWeightsTable(const std::string& path);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  SumWeightsTable() = delete;
+
+  /**
+   * @brief Deleted copy constructor
+   *
+   */
+  SumWeightsTable(const SumWeightsTable&) = delete;
+
+  /**
+   * @brief Deleted assignment operator
+   *
+   */
+  SumWeightsTable& operator=(const SumWeightsTable&) = delete;
+
+  /**
+   * @brief Destroy the Sum Weights Table object
+   *
+   */
+  ~SumWeightsTable() = default;
+
+  /**
+   * @brief Sums of weights of all variations of a UniqueSampleID
+   *
+   * @param id
+   * @return std::vector<std::pair<std::string, double> > Variation | sum of weights
+   */
+  std::vector<std::pair<std::string, double> > sumWeights(const UniqueSampleID& id) const;
+
+  /**
+   * @brief Check if the table was produced from a sum_of_weights.txt file. The content of the file
+   * is only read if its modification time changed (e.g. when it was copied)
+   *
+   * @param textPath
+   * @return true
+   * @return false
+   */
+  bool matches(const std::string& textPath) const;
+
+  /**
+   * @brief Number of entries (UniqueSampleIDs x variations)
+   *
+   * @return std::size_t
+   */
+  inline std::size_t size() const {return m_nEntries;}
+
+  /**
+   * @brief Write a table
+   *
+   * @param path
+   * @param entries
+   * @param textPath sum_of_weights.txt with the same entries, its fingerprint is stored in the table
+   */
+  static void write(const std::string& path, const Entries& entries, const std::string& textPath);
+
+  /**
+   * @brief Read sum_of_weights.txt (lines "<DSID> <CAMPAIGN> <SIMULATION> <VARIATION> <SUMWEIGHTS>")
+   *
+   * @param path
+   * @return Entries
+   */
+  static Entries readText(const std::string& path);
+
+  /**
+   * @brief Path of the table that belongs to a sum_of_weights.txt file
+   *
+   * @param textPath
+   * @return std::string
+   */
+  static std::string tablePath(const std::string& textPath);
+
+private:
+
+  /**
+   * @brief Identifies the sum_of_weights.txt a table was produced from
+   *
+   */
+  struct Fingerprint {
+    std::uint64_t size;
+    std::int64_t time;
+    std::uint64_t hash;
+  };
+
+  /**
+   * @brief Fingerprint of a file
+   *
+   * @param path
+   * @param withHash Read the file to compute the hash of its content, otherwise the hash is 0
+   * @return Fingerprint
+   */
+  static Fingerprint fingerprint(const std::string& path, const bool withHash);
+
+  /**
+   * @brief Entry of the table, the key is stored in the string block
+   *
+   */
+  struct Entry {
+    std::uint64_t keyOffset;
+    std::uint32_t keyLength;
+    std::uint32_t padding;
+    double value;
+  };
+
+  /**
+   * @brief Key of an entry, throws if the key is outside of the file
+   *
+   * @param entry
+   * @return std::string_view
+   */
+  std::string_view key(const Entry& entry) const;
+
+  MappedFile m_file;
+  Fingerprint m_source;
+  const Entry* m_entries;
+  std::uint64_t m_nEntries;
+  const char* m_keys;
+  std::size_t m_keysSize;
+};
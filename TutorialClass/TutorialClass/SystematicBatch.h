@@ -0,0 +1,351 @@
+/**
+ * @file SystematicBatch.h
+ * @brief Inputs of a systematic define that is evaluated for all systematic variations in one call
+ *
+ */
+
+#pragma once
+
+#include "FastFrames/Logger.h"
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include "ROOT/TypeTraits.hxx"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Values of one input column for all systematic variations of a batched define.
+ * Position 0 is the nominal, variations that do not change the column point to the same value
+ *
+ * @tparam T Type of the column
+ */
+template<typename T>
+class SystematicBatch {
+public:
+
+  using value_type = T;
+
+  /**
+   * @brief Construct a new Systematic Batch object
+   *
+   * @param values Pointers to the values, one per variation
+   * @param size Number of variations
+   */
+  explicit SystematicBatch(const void* const* values, const std::size_t size) :
+    m_values(values),
+    m_size(size)
+  {
+  }
+
+  /**
+   * @brief Number of variations
+   *
+   * @return std::size_t
+   */
+  inline std::size_t size() const {return m_size;}
+
+  /**
+   * @brief Value for a variation
+   *
+   * @param i Position of the variation
+   * @return const T&
+   */
+  inline const T& operator[](const std::size_t i) const {return *static_cast<const T*>(m_values[i]);}
+
+  /**
+   * @brief Check if two variations read the same column, their values are then identical
+   * and the work done for one of them can be reused for the other
+   *
+   * @param i
+   * @param j
+   * @return true
+   * @return false
+   */
+  inline bool sameAs(const std::size_t i, const std::size_t j) const {return m_values[i] == m_values[j];}
+
+private:
+  const void* const* m_values;
+  std::size_t m_size;
+};
+
+/**
+ * @brief Column with the results of all variations of a batched define (see TutorialClass::systematicDefineBatched).
+ * Batched defines read it by index, the column of a single variation (with "NOSYS" replaced by the variation)
+ * is only defined by defineVariation when code that is not batched reads it
+ *
+ */
+struct BatchedColumn {
+
+  /**
+   * @brief Name of the column with the results of all variations
+   *
+   */
+  std::string column;
+
+  /**
+   * @brief Variations in the order of the results, the nominal first
+   *
+   */
+  std::vector<std::string> variations;
+
+  /**
+   * @brief Type of the result of one variation
+   *
+   */
+  const std::type_info* valueType = nullptr;
+
+  /**
+   * @brief Define a column with the addresses of the results at the given positions, read by a batched define
+   *
+   */
+  std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, const std::string&, const std::vector<std::size_t>&)> packAddresses;
+
+  /**
+   * @brief Define the column of the variation at the given position
+   *
+   */
+  std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, const std::size_t)> defineVariation;
+};
+
+/**
+ * @brief Batched columns by the name of their nominal column (containing "NOSYS")
+ *
+ */
+using BatchedColumns = std::map<std::string, BatchedColumn>;
+
+namespace SystematicBatchDetail {
+
+  /**
+   * @brief Number of columns read by one typed Define of the packed addresses
+   *
+   */
+  constexpr std::size_t chunkSize = 8;
+
+  template<std::size_t, typename T>
+  using Repeated = T;
+
+  template<typename>
+  using Addresses = ROOT::VecOps::RVec<const void*>;
+
+  /**
+   * @brief Preallocated per slot buffer with the addresses of the values of one argument, per variation,
+   * and the positions in it that each column read by a chunk is written to
+   *
+   */
+  class AddressBuffer {
+  public:
+    explicit AddressBuffer(const std::shared_ptr<std::vector<std::vector<const void*> > >& buffers,
+                           const std::vector<std::vector<std::size_t> >& positions) :
+      m_buffers(buffers),
+      m_positions(positions) {}
+
+    ROOT::VecOps::RVec<const void*> write(const unsigned int slot, const std::array<const void*, chunkSize>& addresses) const {
+      std::vector<const void*>& buffer = (*m_buffers)[slot];
+      for (std::size_t i = 0; i < m_positions.size(); ++i) {
+        for (const std::size_t position : m_positions[i]) {
+          buffer[position] = addresses[i];
+        }
+      }
+
+      // a view of the buffer, nothing is allocated per event
+      return ROOT::VecOps::RVec<const void*>(buffer.data(), buffer.size());
+    }
+
+  private:
+    std::shared_ptr<std::vector<std::vector<const void*> > > m_buffers;
+    std::vector<std::vector<std::size_t> > m_positions;
+  };
+
+  /**
+   * @brief Typed Define reading chunkSize columns of type T and writing their addresses to an AddressBuffer.
+   * The values stay valid while the event is processed. The chunks of an argument are chained
+   * (each one reads the result of the previous chunk) so that the last chunk is only evaluated once all addresses are written
+   *
+   */
+  template<typename T, bool First, typename Indices = std::make_index_sequence<chunkSize> >
+  class AddressChunk;
+
+  template<typename T, std::size_t... I>
+  class AddressChunk<T, true, std::index_sequence<I...> > : public AddressBuffer {
+  public:
+    using AddressBuffer::AddressBuffer;
+
+    ROOT::VecOps::RVec<const void*> operator()(const unsigned int slot, const Repeated<I, T>&... values) const {
+      return this->write(slot, {static_cast<const void*>(&values)...});
+    }
+  };
+
+  template<typename T, std::size_t... I>
+  class AddressChunk<T, false, std::index_sequence<I...> > : public AddressBuffer {
+  public:
+    using AddressBuffer::AddressBuffer;
+
+    ROOT::VecOps::RVec<const void*> operator()(const unsigned int slot,
+                                               const ROOT::VecOps::RVec<const void*>& /*previous*/,
+                                               const Repeated<I, T>&... values) const {
+      return this->write(slot, {static_cast<const void*>(&values)...});
+    }
+  };
+
+  /**
+   * @brief Define a column with the addresses of the values of the columns, one per variation.
+   * Variations reading the same column get the same address (see SystematicBatch::sameAs)
+   *
+   * @tparam T Type of the columns
+   * @param node
+   * @param name Name of the new column
+   * @param columns Columns per variation
+   * @return ROOT::RDF::RNode
+   */
+  template<typename T>
+  ROOT::RDF::RNode packAddresses(ROOT::RDF::RNode node, const std::string& name, const std::vector<std::string>& columns) {
+
+    // distinct columns and the variations reading them
+    std::vector<std::string> distinct;
+    std::vector<std::vector<std::size_t> > positions;
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+      auto itr = std::find(distinct.begin(), distinct.end(), columns.at(i));
+      if (itr == distinct.end()) {
+        distinct.emplace_back(columns.at(i));
+        positions.emplace_back();
+        itr = distinct.end() - 1;
+      }
+      positions.at(itr - distinct.begin()).emplace_back(i);
+    }
+
+    auto buffers = std::make_shared<std::vector<std::vector<const void*> > >(node.GetNSlots(), std::vector<const void*>(columns.size(), nullptr));
+
+    // the last chunk is padded with the last column, without positions to write to
+    const std::size_t nChunks = (distinct.size() + chunkSize - 1)/chunkSize;
+    std::string previous;
+    for (std::size_t ichunk = 0; ichunk < nChunks; ++ichunk) {
+      std::vector<std::string> chunkColumns;
+      std::vector<std::vector<std::size_t> > chunkPositions;
+      for (std::size_t i = ichunk*chunkSize; i < (ichunk + 1)*chunkSize; ++i) {
+        chunkColumns.emplace_back(distinct.at(std::min(i, distinct.size() - 1)));
+        chunkPositions.emplace_back(i < distinct.size() ? positions.at(i) : std::vector<std::size_t>{});
+      }
+
+      const std::string chunkName = ichunk + 1 == nChunks ? name : name + "_chunk" + std::to_string(ichunk);
+      if (ichunk == 0) {
+        node = node.DefineSlot(chunkName, AddressChunk<T, true>(buffers, chunkPositions), chunkColumns);
+      } else {
+        chunkColumns.insert(chunkColumns.begin(), previous);
+        node = node.DefineSlot(chunkName, AddressChunk<T, false>(buffers, chunkPositions), chunkColumns);
+      }
+      previous = chunkName;
+    }
+
+    return node;
+  }
+
+  /**
+   * @brief Define a column with the addresses of the results of a batched column at the given positions,
+   * written to a preallocated per slot buffer
+   *
+   * @tparam Result Type of the batched column
+   * @param node
+   * @param name Name of the new column
+   * @param batchedColumn
+   * @param positions Position in the batched column, per variation
+   * @return ROOT::RDF::RNode
+   */
+  template<typename Result>
+  ROOT::RDF::RNode packBatchedAddresses(ROOT::RDF::RNode node,
+                                        const std::string& name,
+                                        const std::string& batchedColumn,
+                                        const std::vector<std::size_t>& positions) {
+
+    auto buffers = std::make_shared<std::vector<std::vector<const void*> > >(node.GetNSlots(), std::vector<const void*>(positions.size(), nullptr));
+    return node.DefineSlot(name,
+                           [buffers, positions](const unsigned int slot, const Result& all) {
+                             std::vector<const void*>& buffer = (*buffers)[slot];
+                             for (std::size_t i = 0; i < positions.size(); ++i) {
+                               buffer[i] = static_cast<const void*>(&all[positions[i]]);
+                             }
+                             return ROOT::VecOps::RVec<const void*>(buffer.data(), buffer.size());
+                           },
+                           {batchedColumn});
+  }
+
+  /**
+   * @brief Input of one argument of a batched define: a batched column read by index
+   * (with the position of each variation in it), or nullptr when the argument reads one column per variation
+   *
+   */
+  using BatchedInput = std::pair<const BatchedColumn*, std::vector<std::size_t> >;
+
+  template<typename F, typename Result, typename ArgTypes>
+  class BatchedCall;
+
+  /**
+   * @brief Typed Define calling the user function with the packed addresses of all arguments.
+   * The function is owned by the Define, it lives as long as the graph
+   *
+   */
+  template<typename F, typename Result, typename... Args>
+  class BatchedCall<F, Result, ROOT::TypeTraits::TypeList<Args...> > {
+  public:
+    explicit BatchedCall(F function, const std::size_t nVariations) :
+      m_function(std::move(function)),
+      m_nVariations(nVariations) {}
+
+    /**
+     * @brief Define the packed addresses of every argument
+     *
+     * @param node
+     * @param names Names of the packed columns, per argument
+     * @param columns Input columns, per argument, per variation
+     * @param inputs Batched column read by the argument, per argument
+     * @return ROOT::RDF::RNode
+     */
+    static ROOT::RDF::RNode pack(ROOT::RDF::RNode node,
+                                 const std::vector<std::string>& names,
+                                 const std::vector<std::vector<std::string> >& columns,
+                                 const std::vector<BatchedInput>& inputs) {
+      return pack(node, names, columns, inputs, std::index_sequence_for<Args...>{});
+    }
+
+    Result operator()(const Addresses<Args>&... addresses) const {
+      return m_function(Args(addresses.data(), m_nVariations)...);
+    }
+
+  private:
+    template<typename T>
+    static ROOT::RDF::RNode packArgument(ROOT::RDF::RNode node,
+                                         const std::string& name,
+                                         const std::vector<std::string>& columns,
+                                         const BatchedInput& input) {
+      if (!input.first) return packAddresses<T>(node, name, columns);
+
+      if (*input.first->valueType != typeid(T)) {
+        LOG(ERROR) << "The batched column: " << input.first->column << " does not have the type of the argument reading it\n";
+        throw std::invalid_argument("");
+      }
+      return input.first->packAddresses(node, name, input.second);
+    }
+
+    template<std::size_t... I>
+    static ROOT::RDF::RNode pack(ROOT::RDF::RNode node,
+                                 const std::vector<std::string>& names,
+                                 const std::vector<std::vector<std::string> >& columns,
+                                 const std::vector<BatchedInput>& inputs,
+                                 std::index_sequence<I...>) {
+      ((node = packArgument<typename Args::value_type>(node, names.at(I), columns.at(I), inputs.at(I))), ...);
+      return node;
+    }
+
+    F m_function;
+    std::size_t m_nVariations;
+  };
+}
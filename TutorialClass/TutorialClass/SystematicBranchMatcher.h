@@ -0,0 +1,99 @@
+/**
+ * @file SystematicBranchMatcher.h
+ * @brief Classification of the input branches into nominal branches and their systematic variations
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Class that finds the systematic variations in a list of branches in one pass.
+ * The systematic names are stored in a trie, every branch is scanned once from each
+ * "_"-separated position and a match is a variation if the branch with the systematic name
+ * replaced by "NOSYS" exists
+ *
+ */
+class SystematicBranchMatcher {
+public:
+
+  /**
+   * @brief Systematic variation of a branch, positions in the list of branches and in the list of systematics
+   *
+   */
+  struct Variation {
+    std::size_t branch;
+    std::size_t nominal;
+    std::size_t systematic;
+  };
+
+  /**
+   * @brief Construct a new Systematic Branch Matcher object
+   *
+   * @param systematics Names of the systematics, "NOSYS" is ignored
+   */
+  explicit SystematicBranchMatcher(const std::vector<std::string>& systematics);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  SystematicBranchMatcher() = delete;
+
+  /**
+   * @brief Destroy the Systematic Branch Matcher object
+   *
+   */
+  ~SystematicBranchMatcher() = default;
+
+  /**
+   * @brief Find the systematic variations
+   *
+   * @param branches All branches
+   * @return std::vector<Variation>
+   */
+  std::vector<Variation> variations(const std::vector<std::string>& branches) const;
+
+  /**
+   * @brief Keep only the nominal branches with at least one variation and the variations,
+   * other branches do not change the systematic maps of SystematicReplacer
+   *
+   * @param branches All branches
+   * @return std::vector<std::string>
+   */
+  std::vector<std::string> affectedBranches(const std::vector<std::string>& branches) const;
+
+  /**
+   * @brief Stable 64 bit hash (FNV-1a) of the branches and the systematics, identifies an input schema
+   *
+   * @param branches
+   * @return std::uint64_t
+   */
+  std::uint64_t schemaHash(const std::vector<std::string>& branches) const;
+
+private:
+
+  /**
+   * @brief Node of the trie, children are sorted by character
+   *
+   */
+  struct Node {
+    std::vector<std::pair<char, std::size_t> > children;
+    long long int systematic = -1;
+  };
+
+  /**
+   * @brief Get the child of a node
+   *
+   * @param node
+   * @param c
+   * @return std::size_t 0 if there is no child (the root is never a child)
+   */
+  std::size_t child(const std::size_t node, const char c) const;
+
+  std::vector<Node> m_nodes;
+  std::vector<std::string> m_systematics;
+};
@@ -0,0 +1,267 @@
+/**
+ * @file SystematicHistoAction.h
+ * @brief RDataFrame action filling all systematic variations of a variable in one callback
+ *
+ */
+
+#pragma once
+
+#include "TutorialClass/HistoAxis.h"
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include "TH1D.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TTreeReader;
+
+/**
+ * @brief Per bin aggregates of a group of variations, in the order returned by SystematicHistoResult::aggregates
+ *
+ */
+enum class VariationAggregate {
+  ENVELOPE_UP = 0,
+  ENVELOPE_DOWN,
+  RMS_UP,
+  RMS_DOWN
+};
+
+/**
+ * @brief Per bin contents and errors of the aggregates of a group of variations, indexed by VariationAggregate
+ *
+ */
+struct VariationAggregates {
+  std::array<std::vector<double>, 4> contents;
+  std::array<std::vector<double>, 4> errors;
+  std::array<double, 4> stats{};
+  double entries = 0;
+};
+
+/**
+ * @brief Result of the SystematicHistoAction.
+ * Stores sum of weights and sum of squared weights in a dense [systematic x bin] layout
+ * and the statistics used for the mean and RMS per systematic (same layout as TH1::GetStats)
+ *
+ */
+class SystematicHistoResult {
+public:
+
+  /**
+   * @brief Number of statistics per systematic: sumw, sumw2, sumwx, sumwx2
+   *
+   */
+  static constexpr std::size_t nStats = 4;
+
+  /**
+   * @brief Construct a new Systematic Histo Result object
+   *
+   * @param axis Binning
+   * @param title Title of the histograms
+   * @param nSystematics Number of systematic variations
+   */
+  explicit SystematicHistoResult(const HistoAxis& axis, const std::string& title, const std::size_t nSystematics);
+
+  /**
+   * @brief Destroy the Systematic Histo Result object
+   *
+   */
+  ~SystematicHistoResult() = default;
+
+  /**
+   * @brief Get the binning
+   *
+   * @return const HistoAxis&
+   */
+  inline const HistoAxis& axis() const {return m_axis;}
+
+  /**
+   * @brief Number of systematic variations
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nSystematics() const {return m_nSystematics;}
+
+  /**
+   * @brief Fill one value of a systematic into per-slot content. As in TH1::Fill,
+   * only values within the range of the axis enter the statistics
+   *
+   * @param sumW
+   * @param sumW2
+   * @param stats
+   * @param systematic Index of the systematic
+   * @param value
+   * @param weight
+   */
+  inline void fillValue(double* sumW, double* sumW2, double* stats,
+                        const std::size_t systematic, const double value, const double weight) const {
+    const std::size_t bin = m_axis.findBin(value);
+    const std::size_t index = systematic*m_axis.nbinsWithFlows() + bin;
+    sumW[index]  += weight;
+    sumW2[index] += weight*weight;
+    if (bin == 0 || bin > m_axis.nbins()) return;
+
+    double* systStats = stats + systematic*nStats;
+    systStats[0] += weight;
+    systStats[1] += weight*weight;
+    systStats[2] += weight*value;
+    systStats[3] += weight*value*value;
+  }
+
+  /**
+   * @brief Add (merge) per-slot content
+   *
+   * @param sumW
+   * @param sumW2
+   * @param stats
+   * @param entries
+   */
+  void add(const std::vector<double>& sumW,
+           const std::vector<double>& sumW2,
+           const std::vector<double>& stats,
+           const std::vector<double>& entries);
+
+  /**
+   * @brief Convert one systematic variation to TH1D, only to be called when writing the output
+   *
+   * @param systematic Index of the systematic
+   * @param name Name of the histogram
+   * @return std::unique_ptr<TH1D>
+   */
+  std::unique_ptr<TH1D> histo(const std::size_t systematic, const std::string& name) const;
+
+  /**
+   * @brief Reduce a group of variations to per bin aggregates (see VariationAggregate): maximum and minimum
+   * of the variations (envelope) and mean +- standard deviation of the variations (RMS).
+   * The standard deviation follows the replica convention of PDF4LHC: sqrt(sum((x_i - mean)^2)/(N - 1))
+   * over the N members of the group, 0 for a single member.
+   * Sum, sum of squares, minimum and maximum are accumulated in one pass over the variations.
+   * The variations are filled from the same events, so their statistical errors are not combined:
+   * the error of the envelope is the error of the variation at the maximum (minimum),
+   * the error of the RMS is the quadratic mean of the errors of the variations.
+   * The number of entries and the statistics are the means of those of the variations
+   *
+   * @param variations Indices of the variations, one per member: members sharing a variation
+   * (identical weights) repeat its index
+   * @return VariationAggregates
+   */
+  VariationAggregates aggregateBins(const std::vector<std::size_t>& variations) const;
+
+  /**
+   * @brief Convert the aggregates of a group of variations (see aggregateBins) to TH1D, only to be called when writing the output
+   *
+   * @param variations Indices of the variations
+   * @param name Name of the histograms
+   * @return std::array<std::unique_ptr<TH1D>, 4>
+   */
+  std::array<std::unique_ptr<TH1D>, 4> aggregates(const std::vector<std::size_t>& variations, const std::string& name) const;
+
+private:
+  HistoAxis m_axis;
+  std::string m_title;
+  std::size_t m_nSystematics;
+  std::vector<double> m_sumW;
+  std::vector<double> m_sumW2;
+  std::vector<double> m_stats;
+  std::vector<double> m_entries;
+};
+
+/**
+ * @brief Custom RDataFrame action that fills one variable for all systematic variations in one callback.
+ * The inputs are the packed per-systematic values, weights and selection decisions
+ *
+ */
+class SystematicHistoAction : public ROOT::Detail::RDF::RActionImpl<SystematicHistoAction> {
+public:
+
+  using Result_t = SystematicHistoResult;
+
+  /**
+   * @brief Construct a new Systematic Histo Action object
+   *
+   * @param axis Binning
+   * @param title Title of the histograms
+   * @param nSystematics Number of systematic variations
+   */
+  explicit SystematicHistoAction(const HistoAxis& axis, const std::string& title, const std::size_t nSystematics);
+
+  /**
+   * @brief Deleted copy constructor
+   *
+   */
+  SystematicHistoAction(const SystematicHistoAction&) = delete;
+
+  /**
+   * @brief Default move constructor
+   *
+   */
+  SystematicHistoAction(SystematicHistoAction&&) = default;
+
+  /**
+   * @brief Destroy the Systematic Histo Action object
+   *
+   */
+  ~SystematicHistoAction() = default;
+
+  /**
+   * @brief Get the result (needed by RDataFrame)
+   *
+   * @return std::shared_ptr<Result_t>
+   */
+  std::shared_ptr<Result_t> GetResultPtr() const {return m_result;}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void Initialize() {}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void InitTask(TTreeReader*, unsigned int) {}
+
+  /**
+   * @brief Fill all systematic variations
+   *
+   * @param slot
+   * @param values Value of the variable per systematic
+   * @param weights Weight per systematic
+   * @param passed Selection decision per systematic
+   */
+  void Exec(unsigned int slot,
+            const ROOT::VecOps::RVec<double>& values,
+            const ROOT::VecOps::RVec<double>& weights,
+            const ROOT::VecOps::RVec<char>& passed);
+
+  /**
+   * @brief Merge the per-slot content into the result
+   *
+   */
+  void Finalize();
+
+  /**
+   * @brief Name of the action
+   *
+   * @return std::string
+   */
+  std::string GetActionName() const {return "SystematicHisto";}
+
+private:
+  std::shared_ptr<Result_t> m_result;
+  std::size_t m_nSystematics;
+  std::size_t m_nbins;
+
+  /**
+   * @brief per slot, dense [systematic x bin] content
+   *
+   */
+  std::vector<std::vector<double> > m_sumW;
+  std::vector<std::vector<double> > m_sumW2;
+  std::vector<std::vector<double> > m_stats;
+  std::vector<std::vector<double> > m_entries;
+};
@@ -0,0 +1,174 @@
+/**
+ * @file SystematicIndex.h
+ * @brief Cache of the systematic replacements used while building the graph
+ *
+ */
+
+#pragma once
+
+#include "FastFrames/SystematicReplacer.h"
+#include "FastFrames/Systematic.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Class that interns the formulas, the branches and the systematic names into integer IDs and caches
+ * SystematicReplacer::replaceString per [formula x systematic].
+ * The same selections, variables and weights are replaced many times while the histograms are booked,
+ * each replacement is only computed once. The branches affected by systematics are stored as a [branch x systematic] bitset,
+ * a formula that reads no branch affected by a systematic is returned as it is without calling the replacer.
+ * Branches added to the replacer after the index is built (e.g. by SystematicReplacer::addVariableAndEffectiveSystematics)
+ * are picked up at the next call, the cached replacements of the formulas containing them are recomputed.
+ * Changes of the systematics of existing branches (SystematicReplacer::updateVariableAndEffectiveSystematics) are not detected
+ *
+ */
+class SystematicIndex {
+public:
+
+  /**
+   * @brief Construct a new Systematic Index object
+   *
+   * @param replacer
+   */
+  explicit SystematicIndex(const SystematicReplacer& replacer);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  SystematicIndex() = delete;
+
+  /**
+   * @brief Destroy the Systematic Index object
+   *
+   */
+  ~SystematicIndex() = default;
+
+  /**
+   * @brief Same as SystematicReplacer::replaceString, cached
+   *
+   * @param original
+   * @param systematic
+   * @return std::string A copy, the cached replacements are invalidated when new branches are added
+   */
+  std::string replaceString(const std::string& original, const std::shared_ptr<Systematic>& systematic);
+
+  /**
+   * @brief Same as SystematicReplacer::branchExists, with a hash lookup instead of a search in the list of branches
+   *
+   * @param branch
+   * @return true
+   * @return false
+   */
+  bool branchExists(const std::string& branch);
+
+  /**
+   * @brief Check if a systematic has a variation of a branch
+   *
+   * @param branch
+   * @param systematic
+   * @return true
+   * @return false
+   */
+  bool affects(const std::string& branch, const std::string& systematic);
+
+  /**
+   * @brief Number of calls of replaceString
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nLookups() const {return m_nLookups;}
+
+  /**
+   * @brief Number of replacements computed by the SystematicReplacer
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nComputed() const {return m_nComputed;}
+
+private:
+
+  /**
+   * @brief Get the ID of a string, new strings get the next ID
+   *
+   * @param ids
+   * @param text
+   * @return std::uint32_t
+   */
+  static std::uint32_t intern(std::unordered_map<std::string, std::uint32_t>& ids, const std::string& text);
+
+  /**
+   * @brief Add the branches added to the replacer since the last call
+   * and forget what was cached for the formulas containing them
+   *
+   */
+  void update();
+
+  /**
+   * @brief Get the ID of a branch, the row of the bitset is filled when the branch is first used
+   *
+   * @param branch
+   * @return std::uint32_t
+   */
+  std::uint32_t branchId(const std::string& branch);
+
+  /**
+   * @brief Get the ID of a formula, the branches affected by systematics that it reads are found when the formula is first used
+   *
+   * @param formula
+   * @return std::uint32_t
+   */
+  std::uint32_t formulaId(const std::string& formula);
+
+  /**
+   * @brief Check a bit of the [branch x systematic] table
+   *
+   * @param branch
+   * @param systematic
+   * @return true
+   * @return false
+   */
+  inline bool bit(const std::uint32_t branch, const std::uint32_t systematic) const {
+    const std::vector<std::uint64_t>& row = m_bits[branch];
+    return systematic/64 < row.size() && ((row[systematic/64] >> (systematic%64)) & 1u);
+  }
+
+  const SystematicReplacer& m_replacer;
+
+  /**
+   * @brief Number of branches of the replacer already in m_allBranches
+   *
+   */
+  std::size_t m_nBranches;
+  std::unordered_set<std::string> m_allBranches;
+
+  std::unordered_map<std::string, std::uint32_t> m_branchIds;
+  std::unordered_map<std::string, std::uint32_t> m_formulaIds;
+  std::unordered_map<std::string, std::uint32_t> m_systematicIds;
+
+  /**
+   * @brief Per branch ID, bits of the systematic IDs affecting it
+   *
+   */
+  std::vector<std::vector<std::uint64_t> > m_bits;
+
+  /**
+   * @brief Per formula ID, the formula and the IDs of the branches affected by systematics it reads
+   *
+   */
+  std::vector<std::string> m_formulas;
+  std::vector<std::vector<std::uint32_t> > m_formulaBranches;
+
+  /**
+   * @brief key = formula ID << 32 | systematic ID, value = replaced formula
+   *
+   */
+  std::unordered_map<std::uint64_t, std::string> m_replaced;
+  std::size_t m_nLookups;
+  std::size_t m_nComputed;
+};
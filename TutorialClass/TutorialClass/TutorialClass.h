@@ -3,14 +3,22 @@
 #include "FastFrames/MainFrame.h"
 
 #include "FastFrames/ConfigSetting.h"
+#include "FastFrames/Logger.h"
 #include "FastFrames/Sample.h"
+#include "FastFrames/StringOperations.h"
 #include "FastFrames/UniqueSampleID.h"
 
+#include "TutorialClass/NormalisationTable.h"
+#include "TutorialClass/SystematicBatch.h"
+
 #include "Math/Vector4D.h"
 #include "ROOT/RDataFrame.hxx"
 #include "TClass.h"
 
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 using TLV = ROOT::Math::PtEtaPhiEVector;
 
@@ -23,7 +31,32 @@ public:
 
   virtual ~TutorialClass() = default;
 
-  virtual void init() override final {MainFrame::init();}
+  /**
+   * @brief Initialise the metadata. With custom option "indexed_sum_weights: true" only the sums of weights
+   * of the UniqueSampleIDs and systematics of this job are read from the indexed table (see SumWeightsTable).
+   * The cross-section files listed in "filtered_xsection_files" are read after MainFrame::init(), together with the files
+   * of the config, and only the lines of the used DSIDs of all of them are passed to the cross-section reader
+   * (MetadataManager only takes the cross sections from files).
+   * With "single_graph_per_sample: true" the normalisations are stored in a NormalisationTable
+   *
+   */
+  virtual void init() override final;
+
+  /**
+   * @brief Process histograms. With custom option "single_graph_per_sample: true"
+   * all UniqueSampleIDs of a Sample are processed in one graph (see SampleGraph),
+   * samples not supported by this mode use the standard processing. Throws with custom option "dry_run"
+   * without "single_graph_per_sample"
+   *
+   */
+  virtual void executeHistograms() override final;
+
+  /**
+   * @brief Process ntuples with the standard processing. Throws with custom option "dry_run",
+   * the plan is only available for histograms
+   *
+   */
+  virtual void executeNtuples() override final;
 
   virtual ROOT::RDF::RNode defineVariables(ROOT::RDF::RNode mainNode,
                                            const std::shared_ptr<Sample>& sample,
@@ -42,8 +75,175 @@ public:
                                                       const std::string& treeName,
                                                       const std::shared_ptr<Sample>& sample,
                                                       const UniqueSampleID& sampleID) override final;
+protected:
+
+  /**
+   * @brief Same as MainFrame::systematicDefine, but the function is called once per event for all variations.
+   * Each argument is a SystematicBatch<T> with the values of the input column for the nominal (position 0)
+   * and for every systematic affecting the inputs, the function returns a container with one result per variation.
+   * Work that does not depend on the varied inputs (e.g. sorting or selection masks) can be shared between the variations.
+   * All nodes are typed Defines, nothing is JIT compiled: the addresses of the inputs are packed per argument
+   * (one Define per 8 distinct input columns), one Define calls the function and stores the results of all variations
+   * in the column with "NOSYS" replaced by "batched_fastframes" (see BatchedColumn).
+   * Inputs produced by another batched define are read from its batched column by index.
+   * With "single_graph_per_sample" the column of a single variation is only defined (copying its element of the result)
+   * when the graph reads it, i.e. when a selection, weight, variable or config define of the processed systematics uses it.
+   * Code in defineVariables that is not batched (e.g. MainFrame::systematicDefine) has to call defineBatchedVariations first.
+   * The standard processing defines the columns of all variations
+   *
+   * @tparam F
+   * @param node Input node
+   * @param newVariable Name of the new column, has to contain "NOSYS"
+   * @param defineFunction Function taking SystematicBatch<T> per input and returning e.g. std::vector<R>
+   * @param branches Nominal input columns
+   * @return ROOT::RDF::RNode Output node with the new columns
+   */
+  template<typename F>
+  ROOT::RDF::RNode systematicDefineBatched(ROOT::RDF::RNode node,
+                                           const std::string& newVariable,
+                                           F defineFunction,
+                                           const std::vector<std::string>& branches) {
+
+    using Result = typename ROOT::TypeTraits::CallableTraits<F>::ret_type;
+    using ArgTypes = typename ROOT::TypeTraits::CallableTraits<F>::arg_types;
+    using Value = typename Result::value_type;
+
+    if (newVariable.find("NOSYS") == std::string::npos) {
+      LOG(ERROR) << "The new variable name: \"" << newVariable << "\" does not contain \"NOSYS\"\n";
+      throw std::invalid_argument("");
+    }
+
+    if (ArgTypes::list_size != branches.size()) {
+      LOG(ERROR) << "The batched define of: " << newVariable << " has " << ArgTypes::list_size << " arguments but " << branches.size() << " branches are provided\n";
+      throw std::invalid_argument("");
+    }
+
+    bool variableExists(false);
+    if (m_systReplacer.branchExists(newVariable)) {
+      LOG(VERBOSE) << "Variable: " << newVariable << " is already in the input, will not add it to the map (but adding it to the node)\n";
+      variableExists = true;
+    }
+
+    // nominal first, then the systematics affecting the inputs
+    const std::vector<std::string> effectiveSystematics = m_systReplacer.getListOfEffectiveSystematics(branches);
+    std::vector<std::string> variations = {"NOSYS"};
+    for (const auto& isystematic : effectiveSystematics) {
+      if (isystematic == "NOSYS") continue;
+      variations.emplace_back(isystematic);
+    }
+
+    // columns per argument, per variation
+    std::vector<std::vector<std::string> > columns(branches.size());
+    for (const auto& ivariation : variations) {
+      const std::vector<std::string> systBranches = m_systReplacer.replaceVector(branches, ivariation);
+      for (std::size_t i = 0; i < branches.size(); ++i) {
+        columns.at(i).emplace_back(systBranches.at(i));
+      }
+    }
+
+    // inputs from other batched defines are read by index, variations that do not affect them read the nominal
+    std::vector<SystematicBatchDetail::BatchedInput> inputs(branches.size());
+    for (std::size_t i = 0; i < branches.size(); ++i) {
+      auto itr = m_batchedColumns.find(branches.at(i));
+      if (itr == m_batchedColumns.end() || !node.HasColumn(itr->second.column)) continue;
+
+      const std::vector<std::string>& inputVariations = itr->second.variations;
+      inputs.at(i).first = &itr->second;
+      for (const auto& ivariation : variations) {
+        auto position = std::find(inputVariations.begin(), inputVariations.end(), ivariation);
+        inputs.at(i).second.emplace_back(position == inputVariations.end() ? 0 : position - inputVariations.begin());
+      }
+    }
+
+    using Call = SystematicBatchDetail::BatchedCall<F, Result, ArgTypes>;
+
+    const std::string batchedColumn = StringOperations::replaceString(newVariable, "NOSYS", "batched_fastframes");
+    std::vector<std::string> addressColumns;
+    for (std::size_t i = 0; i < branches.size(); ++i) {
+      addressColumns.emplace_back(batchedColumn + "_arg" + std::to_string(i));
+    }
+    node = Call::pack(node, addressColumns, columns, inputs);
+    node = node.Define(batchedColumn, Call(defineFunction, variations.size()), addressColumns);
+
+    BatchedColumn batched;
+    batched.column = batchedColumn;
+    batched.variations = variations;
+    batched.valueType = &typeid(Value);
+    batched.packAddresses = [batchedColumn](ROOT::RDF::RNode n, const std::string& name, const std::vector<std::size_t>& positions) {
+      return SystematicBatchDetail::packBatchedAddresses<Result>(n, name, batchedColumn, positions);
+    };
+    batched.defineVariation = [batchedColumn, newVariable, variations](ROOT::RDF::RNode n, const std::size_t i) {
+      const std::string systName = StringOperations::replaceString(newVariable, "NOSYS", variations.at(i));
+      return n.Define(systName, [i](const Result& all) -> Value {return all[i];}, {batchedColumn});
+    };
+    m_batchedColumns[newVariable] = std::move(batched);
+
+    if (!m_deferBatchedVariations) {
+      node = this->defineBatchedVariations(node, newVariable);
+    }
+
+    // tell the replacer about the new columns
+    if (!variableExists) {
+      m_systReplacer.addVariableAndEffectiveSystematics(newVariable, effectiveSystematics);
+    }
+
+    return node;
+  }
+
+  /**
+   * @brief Define the columns of all variations of a batched define (see systematicDefineBatched),
+   * needed before code in defineVariables that is not batched reads them
+   *
+   * @param node
+   * @param newVariable Name of the nominal column of the batched define
+   * @return ROOT::RDF::RNode
+   */
+  ROOT::RDF::RNode defineBatchedVariations(ROOT::RDF::RNode node, const std::string& newVariable) const;
+
 private:
 
+  /**
+   * @brief Write the sums of weights used by the job, read from the indexed table, to a temporary
+   * sum_of_weights.txt and point the config to it
+   *
+   * @return std::string Path of the temporary file, empty if the full text file is used
+   */
+  std::string selectSumWeights();
+
+  /**
+   * @brief DSIDs of the MC UniqueSampleIDs of the config, sorted
+   *
+   * @return std::vector<int>
+   */
+  std::vector<int> usedDSIDs() const;
+
+  /**
+   * @brief Write the lines of the used DSIDs of the cross-section files to temporary files (see XSectionFileReader)
+   * and replace the paths in the list
+   *
+   * @param xSectionFiles
+   * @return std::string Directory of the temporary files, empty if the full files are used
+   */
+  std::string selectXSections(std::vector<std::string>& xSectionFiles) const;
+
+  /**
+   * @brief Normalisations of all UniqueSampleIDs and sum of weights variations, built in init()
+   *
+   */
+  std::shared_ptr<NormalisationTable> m_normalisations; //!
+
+  /**
+   * @brief Batched defines of the last call of defineVariables, by nominal column
+   *
+   */
+  BatchedColumns m_batchedColumns; //!
+
+  /**
+   * @brief The columns of the single variations of the batched defines are defined by SampleGraph when they are read
+   *
+   */
+  bool m_deferBatchedVariations = false; //!
+
   ClassDefOverride(TutorialClass, 1);
 
 };
@@ -0,0 +1,155 @@
+/**
+ * @file WeightVariationHistoAction.h
+ * @brief RDataFrame action filling one variable for many weight variations (e.g. generator weights) in one callback
+ *
+ */
+
+#pragma once
+
+#include "TutorialClass/FlatHistoAction.h"
+#include "TutorialClass/HistoAxis.h"
+#include "TutorialClass/SystematicHistoAction.h"
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+#include "TROOT.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class TTreeReader;
+
+/**
+ * @brief Custom RDataFrame action for systematics that only change the weight (generator weights, scale factors).
+ * The selection and the filled value are shared, the weights are read from the vector of the weights of all
+ * systematics. The content is kept in a dense [variation x bin] layout (SystematicHistoResult) and only converted
+ * to one histogram per variation when the output is written
+ *
+ * @tparam ColumnType Type of the filled column, scalar or container
+ */
+template<typename ColumnType>
+class WeightVariationHistoAction : public ROOT::Detail::RDF::RActionImpl<WeightVariationHistoAction<ColumnType> > {
+public:
+
+  using Result_t = SystematicHistoResult;
+
+  /**
+   * @brief Construct a new Weight Variation Histo Action object
+   *
+   * @param axis Binning
+   * @param title Title of the histograms
+   * @param weightIndices Position of the weight of each variation in the weight vector
+   */
+  explicit WeightVariationHistoAction(const HistoAxis& axis, const std::string& title, const std::vector<std::size_t>& weightIndices) :
+    m_result(std::make_shared<Result_t>(axis, title, weightIndices.size())),
+    m_weightIndices(weightIndices),
+    m_nbins(axis.nbinsWithFlows()),
+    m_sumW(ROOT::IsImplicitMTEnabled() ? ROOT::GetThreadPoolSize() : 1),
+    m_sumW2(m_sumW.size()),
+    m_stats(m_sumW.size()),
+    m_entries(m_sumW.size())
+  {
+  }
+
+  /**
+   * @brief Deleted copy constructor
+   *
+   */
+  WeightVariationHistoAction(const WeightVariationHistoAction&) = delete;
+
+  /**
+   * @brief Default move constructor
+   *
+   */
+  WeightVariationHistoAction(WeightVariationHistoAction&&) = default;
+
+  /**
+   * @brief Destroy the Weight Variation Histo Action object
+   *
+   */
+  ~WeightVariationHistoAction() = default;
+
+  /**
+   * @brief Get the result (needed by RDataFrame)
+   *
+   * @return std::shared_ptr<Result_t>
+   */
+  std::shared_ptr<Result_t> GetResultPtr() const {return m_result;}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void Initialize() {}
+
+  /**
+   * @brief Needed by RDataFrame
+   *
+   */
+  void InitTask(TTreeReader*, unsigned int) {}
+
+  /**
+   * @brief Fill all variations
+   *
+   * @param slot
+   * @param value Value (or container) of the variable
+   * @param weights Weights of all systematics
+   */
+  void Exec(unsigned int slot, const ColumnType& value, const ROOT::VecOps::RVec<double>& weights) {
+    const std::size_t nVariations = m_weightIndices.size();
+    std::vector<double>& sumW  = m_sumW[slot];
+    std::vector<double>& sumW2 = m_sumW2[slot];
+    std::vector<double>& stats = m_stats[slot];
+    std::vector<double>& entries = m_entries[slot];
+    if (sumW.empty()) {
+      sumW.resize(nVariations*m_nbins, 0.);
+      sumW2.resize(nVariations*m_nbins, 0.);
+      stats.resize(nVariations*Result_t::nStats, 0.);
+      entries.resize(nVariations, 0.);
+    }
+
+    const std::size_t n = FlatHistoDetail::fillSize(value);
+    for (std::size_t i = 0; i < n; ++i) {
+      const double x = FlatHistoDetail::valueAt(value, i);
+      for (std::size_t ivariation = 0; ivariation < nVariations; ++ivariation) {
+        m_result->fillValue(sumW.data(), sumW2.data(), stats.data(), ivariation, x, weights[m_weightIndices[ivariation]]);
+      }
+    }
+    for (std::size_t ivariation = 0; ivariation < nVariations; ++ivariation) {
+      entries[ivariation] += n;
+    }
+  }
+
+  /**
+   * @brief Merge the per-slot content into the result
+   *
+   */
+  void Finalize() {
+    for (std::size_t islot = 0; islot < m_sumW.size(); ++islot) {
+      if (m_sumW.at(islot).empty()) continue;
+      m_result->add(m_sumW.at(islot), m_sumW2.at(islot), m_stats.at(islot), m_entries.at(islot));
+    }
+  }
+
+  /**
+   * @brief Name of the action
+   *
+   * @return std::string
+   */
+  std::string GetActionName() const {return "WeightVariationHisto";}
+
+private:
+  std::shared_ptr<Result_t> m_result;
+  std::vector<std::size_t> m_weightIndices;
+  std::size_t m_nbins;
+
+  /**
+   * @brief per slot, dense [variation x bin] content, empty until the slot fills the histogram
+   *
+   */
+  std::vector<std::vector<double> > m_sumW;
+  std::vector<std::vector<double> > m_sumW2;
+  std::vector<std::vector<double> > m_stats;
+  std::vector<std::vector<double> > m_entries;
+};
@@ -0,0 +1,83 @@
+/**
+ * @file XSectionFileReader.h
+ * @brief Selection of the used DSIDs from PMG/TopDataPreparation cross-section files
+ *
+ */
+
+#pragma once
+
+#include "TutorialClass/MappedFile.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Reads a cross-section file (PMG or TopDataPreparation format) via a memory mapping and keeps
+ * only the lines of the used DSIDs. The lines are tokenised in place, lines of other DSIDs are skipped
+ * without allocating. Lines that do not start with a DSID (header, comments) are kept as they are
+ *
+ */
+class XSectionFileReader {
+public:
+
+  /**
+   * @brief Construct a new XSection File Reader object
+   *
+   * @param path Path to the cross-section file
+   * @param usedDSIDs Sorted DSIDs to keep
+   */
+  explicit XSectionFileReader(const std::string& path, const std::vector<int>& usedDSIDs);
+
+  /**
+   * @brief Deleted default constructor
+   *
+   */
+  XSectionFileReader() = delete;
+
+  /**
+   * @brief Destroy the XSection File Reader object
+   *
+   */
+  ~XSectionFileReader() = default;
+
+  /**
+   * @brief Lines of the used DSIDs, sorted by DSID (in the order of the file for the same DSID)
+   *
+   * @return const std::vector<std::pair<int, std::string_view> >&
+   */
+  inline const std::vector<std::pair<int, std::string_view> >& lines() const {return m_lines;}
+
+  /**
+   * @brief Number of lines with a DSID in the file
+   *
+   * @return std::size_t
+   */
+  inline std::size_t nDSIDLines() const {return m_nDSIDLines;}
+
+  /**
+   * @brief Write the header and the selected lines, in the format of the input file
+   *
+   * @param path
+   */
+  void write(const std::string& path) const;
+
+private:
+
+  /**
+   * @brief Read the DSID at the beginning of a line
+   *
+   * @param line
+   * @param dsid Filled with the DSID
+   * @return true The line starts with a DSID
+   * @return false
+   */
+  static bool readDSID(std::string_view line, int& dsid);
+
+  MappedFile m_file;
+  std::vector<std::string_view> m_header;
+  std::vector<std::pair<int, std::string_view> > m_lines;
+  std::size_t m_nDSIDLines;
+};
@@ -0,0 +1,29 @@
+/**
+ * @file Check.h
+ * @brief Minimal checks for the unit tests, a test executable returns the number of failed checks
+ *
+ */
+
+#pragma once
+
+#include <iostream>
+
+namespace TestCheck {
+
+  /**
+   * @brief Number of failed checks of the test executable
+   *
+   */
+  inline int& failures() {
+    static int result(0);
+    return result;
+  }
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << "\n"; \
+            ++TestCheck::failures(); \
+        } \
+    } while (false)
@@ -0,0 +1,191 @@
+/**
+ * @file test-entry-range-splitter.cc
+ * @brief The job ranges of EntryRangeSplitter cover the selected entries once, are aligned to the clusters
+ * and have similar costs
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/EntryRangeSplitter.h"
+#include "TutorialClass/InputSchemaCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+  struct File {
+    Long64_t entries;
+    Long64_t zipBytes;
+    Long64_t clusterSize;
+  };
+
+  /**
+   * @brief Global entries [begin, end) of each job, -1 for jobs without entries
+   *
+   */
+  std::vector<std::pair<Long64_t, Long64_t> > jobEntries(const EntryRangeSplitter& splitter,
+                                                         const std::vector<File>& files,
+                                                         const std::size_t nJobs) {
+    std::vector<Long64_t> offsets(1, 0);
+    for (const auto& ifile : files) {
+      offsets.emplace_back(offsets.back() + ifile.entries);
+    }
+
+    std::vector<std::pair<Long64_t, Long64_t> > result;
+    for (std::size_t ijob = 0; ijob < nJobs; ++ijob) {
+      const std::vector<EntryRange> ranges = splitter.jobRanges(nJobs, ijob);
+      if (ranges.empty()) {
+        result.emplace_back(-1, -1);
+        continue;
+      }
+      // the ranges of a job are contiguous
+      for (std::size_t i = 0; i + 1 < ranges.size(); ++i) {
+        CHECK(offsets.at(ranges.at(i).file) + ranges.at(i).end == offsets.at(ranges.at(i + 1).file) + ranges.at(i + 1).begin);
+      }
+      result.emplace_back(offsets.at(ranges.front().file) + ranges.front().begin, offsets.at(ranges.back().file) + ranges.back().end);
+    }
+
+    return result;
+  }
+
+  /**
+   * @brief Check that the jobs cover [begin, end) once and in order
+   *
+   */
+  void checkCoverage(const std::vector<std::pair<Long64_t, Long64_t> >& jobs, const Long64_t begin, const Long64_t end) {
+    Long64_t current = begin;
+    for (const auto& [jobBegin, jobEnd] : jobs) {
+      if (jobBegin < 0) continue;
+      CHECK(jobBegin == current);
+      CHECK(jobEnd > jobBegin);
+      current = jobEnd;
+    }
+    CHECK(current == end);
+  }
+}
+
+int main() {
+
+  const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("test_entry_range_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  const InputSchemaCache cache((directory / "cache").string());
+
+  // the second file is small but expensive to read
+  const std::vector<File> files = {{1000, 1000, 100}, {100, 10000, 50}, {1000, 1000, 100}};
+
+  // the splitter reads the entries, the compressed bytes and the clusters from the cache
+  EntryRangeSplitter splitter("reco", &cache);
+  for (std::size_t ifile = 0; ifile < files.size(); ++ifile) {
+    const std::string path = (directory / ("file" + std::to_string(ifile) + ".root")).string();
+    std::ofstream(path) << ifile;
+    std::vector<std::string> values = {std::to_string(files.at(ifile).entries), std::to_string(files.at(ifile).zipBytes)};
+    for (Long64_t icluster = 0; icluster < files.at(ifile).entries; icluster += files.at(ifile).clusterSize) {
+      values.emplace_back(std::to_string(icluster));
+    }
+    cache.write(path, "clusters_reco", values);
+    splitter.addFile(path);
+  }
+  CHECK(splitter.entries(1) == 100);
+
+  // one job processes everything
+  checkCoverage(jobEntries(splitter, files, 1), 0, 2100);
+
+  // no gaps and no overlaps, the boundaries are cluster boundaries
+  const std::size_t nJobs = 3;
+  const std::vector<std::pair<Long64_t, Long64_t> > jobs = jobEntries(splitter, files, nJobs);
+  checkCoverage(jobs, 0, 2100);
+  for (std::size_t ijob = 0; ijob < nJobs; ++ijob) {
+    for (const auto& irange : splitter.jobRanges(nJobs, ijob)) {
+      CHECK(irange.begin % files.at(irange.file).clusterSize == 0);
+      CHECK(irange.end % files.at(irange.file).clusterSize == 0 || irange.end == files.at(irange.file).entries);
+    }
+  }
+
+  // similar costs: fraction of the entries + fraction of the compressed bytes, 2 in total,
+  // up to the cost of a cluster of the second file
+  for (std::size_t ijob = 0; ijob < nJobs; ++ijob) {
+    double cost(0);
+    for (const auto& irange : splitter.jobRanges(nJobs, ijob)) {
+      const File& file = files.at(irange.file);
+      const double entries = irange.end - irange.begin;
+      cost += entries/2100 + entries/file.entries*file.zipBytes/12000;
+    }
+    CHECK(cost > 2./nJobs - 0.25 && cost < 2./nJobs + 0.25);
+  }
+
+  // the small expensive file is a job of its own instead of being added to one of the large files
+  CHECK(jobs.at(1).first == 1000 && jobs.at(1).second == 1100);
+
+  // event range: only the selected entries are split
+  splitter.selectEntries(150, 1150);
+  checkCoverage(jobEntries(splitter, files, 1), 150, 1150);
+  checkCoverage(jobEntries(splitter, files, nJobs), 150, 1150);
+
+  // more jobs than clusters: some jobs are empty
+  splitter.selectEntries(0, 200);
+  const std::vector<std::pair<Long64_t, Long64_t> > manyJobs = jobEntries(splitter, files, 10);
+  checkCoverage(manyJobs, 0, 200);
+  std::size_t empty(0);
+  for (const auto& ijob : manyJobs) {
+    if (ijob.first < 0) ++empty;
+  }
+  CHECK(empty >= 8);
+
+  bool thrown(false);
+  try {
+    splitter.jobRanges(nJobs, nJobs);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  // the file entries table of produce-metadata: the files are neither opened nor looked up in the cache,
+  // lines of other trees are ignored
+  std::vector<EntryRangeSplitter::FileInfo> tableFiles;
+  for (std::size_t ifile = 0; ifile < files.size(); ++ifile) {
+    EntryRangeSplitter::FileInfo info;
+    info.path = (directory / ("missing" + std::to_string(ifile) + ".root")).string();
+    info.entries = files.at(ifile).entries;
+    info.zipBytes = files.at(ifile).zipBytes;
+    for (Long64_t icluster = 0; icluster < info.entries; icluster += files.at(ifile).clusterSize) {
+      info.clusters.emplace_back(icluster);
+    }
+    tableFiles.emplace_back(info);
+  }
+  const std::string tablePath = EntryRangeSplitter::fileEntriesPath(directory.string());
+  EntryRangeSplitter::writeFileEntries(tablePath, "reco", tableFiles);
+  {
+    std::ofstream out(tablePath, std::ios::app);
+    out << "truth " << tableFiles.front().path << " 1 1 0\n";
+  }
+
+  EntryRangeSplitter tableSplitter("reco", nullptr);
+  CHECK(!tableSplitter.readFileEntries((directory / "none.txt").string()));
+  CHECK(tableSplitter.readFileEntries(tablePath));
+  for (const auto& info : tableFiles) {
+    tableSplitter.addFile(info.path);
+  }
+  CHECK(tableSplitter.nOpenedFiles() == 0);
+  CHECK(tableSplitter.entries(0) == 1000 && tableSplitter.entries(1) == 100);
+  splitter.selectEntries(0, -1);
+  for (std::size_t ijob = 0; ijob < nJobs; ++ijob) {
+    const std::vector<EntryRange> tableRanges = tableSplitter.jobRanges(nJobs, ijob);
+    const std::vector<EntryRange> cachedRanges = splitter.jobRanges(nJobs, ijob);
+    CHECK(tableRanges.size() == cachedRanges.size());
+    for (std::size_t i = 0; i < std::min(tableRanges.size(), cachedRanges.size()); ++i) {
+      CHECK(tableRanges.at(i).begin == cachedRanges.at(i).begin && tableRanges.at(i).end == cachedRanges.at(i).end);
+    }
+  }
+  CHECK(splitter.nOpenedFiles() == 0);
+
+  std::filesystem::remove_all(directory);
+
+  return TestCheck::failures();
+}
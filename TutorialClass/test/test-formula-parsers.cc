@@ -0,0 +1,62 @@
+/**
+ * @file test-formula-parsers.cc
+ * @brief Splitting of the selections into shared terms and of the weights into shared factors
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/SampleGraph.h"
+
+#include <string>
+#include <vector>
+
+using Terms = std::vector<std::string>;
+
+int main() {
+
+  // selections: only top-level conjunctions are split
+  CHECK(SampleGraph::selectionTerms("") == Terms({"true"}));
+  CHECK(SampleGraph::selectionTerms("a") == Terms({"a"}));
+  CHECK(SampleGraph::selectionTerms("(a && b) && c") == Terms({"a", "b", "c"}));
+  CHECK(SampleGraph::selectionTerms(" a&&b ") == Terms({"a", "b"}));
+  CHECK(SampleGraph::selectionTerms("a && (b && (c && d))") == Terms({"a", "b", "c", "d"}));
+  CHECK(SampleGraph::selectionTerms("((a && b))") == Terms({"a", "b"}));
+  CHECK(SampleGraph::selectionTerms("f(a, b) && v[0] > 1") == Terms({"f(a, b)", "v[0] > 1"}));
+
+  // "||", "?:" and "," bind weaker than "&&"
+  CHECK(SampleGraph::selectionTerms("a && b || c") == Terms({"a && b || c"}));
+  CHECK(SampleGraph::selectionTerms("(a && b) || (c && d)") == Terms({"(a && b) || (c && d)"}));
+  CHECK(SampleGraph::selectionTerms("a && (b || c) && d") == Terms({"a", "(b || c)", "d"}));
+  CHECK(SampleGraph::selectionTerms("x > 0 ? a && b : c") == Terms({"x > 0 ? a && b : c"}));
+  CHECK(SampleGraph::selectionTerms("a && (x > 0 ? b : c)") == Terms({"a", "(x > 0 ? b : c)"}));
+  CHECK(SampleGraph::selectionTerms("a, b && c") == Terms({"a, b && c"}));
+  CHECK(SampleGraph::selectionTerms("return a && b;") == Terms({"return a && b;"}));
+
+  // string literals are not parsed
+  CHECK(SampleGraph::selectionTerms("name == \"a && b\" && c") == Terms({"name == \"a && b\"", "c"}));
+  CHECK(SampleGraph::selectionTerms("name == \"a || (b\" && c") == Terms({"name == \"a || (b\"", "c"}));
+  CHECK(SampleGraph::selectionTerms("(s == \"a && b\") && c") == Terms({"(s == \"a && b\")", "c"}));
+  CHECK(SampleGraph::selectionTerms("c == '&' && d") == Terms({"c == '&'", "d"}));
+
+  // weights: only plain top-level products are split
+  CHECK(SampleGraph::weightFactors("") == Terms({"1"}));
+  CHECK(SampleGraph::weightFactors("w") == Terms({"w"}));
+  CHECK(SampleGraph::weightFactors("(a*b)*c") == Terms({"a", "b", "c"}));
+  CHECK(SampleGraph::weightFactors(" a * b ") == Terms({"a", "b"}));
+  CHECK(SampleGraph::weightFactors("((a*b))*c") == Terms({"a", "b", "c"}));
+  CHECK(SampleGraph::weightFactors("a*(b*(c*d))") == Terms({"a", "b", "c", "d"}));
+  CHECK(SampleGraph::weightFactors("(a + b)*c") == Terms({"(a + b)", "c"}));
+  CHECK(SampleGraph::weightFactors("f(a*b, c)*v[0]") == Terms({"f(a*b, c)", "v[0]"}));
+
+  CHECK(SampleGraph::weightFactors("a*b + c") == Terms({"a*b + c"}));
+  CHECK(SampleGraph::weightFactors("a/b*c") == Terms({"a/b*c"}));
+  CHECK(SampleGraph::weightFactors("a*b || c") == Terms({"a*b || c"}));
+  CHECK(SampleGraph::weightFactors("x > 0 ? a*b : c") == Terms({"x > 0 ? a*b : c"}));
+  CHECK(SampleGraph::weightFactors("a*(x > 0 ? b : c)") == Terms({"a", "(x > 0 ? b : c)"}));
+  CHECK(SampleGraph::weightFactors("a, b*c") == Terms({"a, b*c"}));
+  CHECK(SampleGraph::weightFactors("*p*c") == Terms({"*p*c"}));
+  CHECK(SampleGraph::weightFactors("w(\"a*b\")*c") == Terms({"w(\"a*b\")*c"}));
+
+  return TestCheck::failures();
+}
@@ -0,0 +1,97 @@
+/**
+ * @file test-histogram-memory.cc
+ * @brief The memory estimate used for the systematic batches matches the buffers allocated by FlatHistoAction,
+ * the post-fill normalisation gives the same content as the normalisation per event
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/FlatHistoAction.h"
+#include "TutorialClass/HistoAxis.h"
+#include "TutorialClass/SampleGraph.h"
+
+#include "FastFrames/Variable.h"
+
+#include "TROOT.h"
+
+#include <cmath>
+#include <vector>
+
+int main() {
+
+  ROOT::DisableImplicitMT();
+
+  Variable x("x");
+  x.setBinning(0., 10., 10);
+  Variable y("y");
+  y.setBinning({0., 1., 5., 20.});
+
+  const std::vector<HistoAxis> axes = {HistoAxis(x), HistoAxis(y)};
+  const std::size_t cells = 12*5;
+
+  // normalisation per event: one buffer per slot
+  {
+    FlatHistoAction<double, double> action(axes);
+    action.Exec(0, 1., 2., 1.);
+    CHECK(action.bufferBytes() == SampleGraph::histogramBytes(cells, 1, 1, 0, true));
+  }
+
+  const std::vector<double> normalisations = {1., 2., 3.};
+
+  // post-fill normalisation: one buffer per slot, whatever the number of UniqueSampleIDs
+  {
+    FlatHistoAction<double, double> action(axes, normalisations);
+    for (std::size_t isample = 0; isample < normalisations.size(); ++isample) {
+      action.Exec(0, 1., 2., 1., isample);
+    }
+    CHECK(action.bufferBytes() == SampleGraph::histogramBytes(cells, 1, 1, 0, true));
+  }
+
+  // the content without normalisation of every UniqueSampleID is only kept for the re-normalisation cache
+  {
+    FlatHistoAction<double, double> action(axes, normalisations, true);
+    for (std::size_t isample = 0; isample < normalisations.size(); ++isample) {
+      action.Exec(0, 1., 2., 1., isample);
+    }
+    action.Finalize();
+    CHECK(action.bufferBytes() == SampleGraph::histogramBytes(cells, 1, 1, normalisations.size(), true));
+  }
+
+  // same content as with the normalisation in the weight, also when a slot comes back to a UniqueSampleID
+  {
+    FlatHistoAction<double, double> perEvent(axes);
+    FlatHistoAction<double, double> postFill(axes, normalisations, true);
+    const std::vector<std::size_t> samples = {0, 0, 1, 2, 2, 0, 1};
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+      const double x = 0.5 + i;
+      const double weight = 0.25*(i + 1);
+      perEvent.Exec(0, x, 2., weight*normalisations.at(samples.at(i)));
+      postFill.Exec(0, x, 2., weight, samples.at(i));
+    }
+    perEvent.Finalize();
+    postFill.Finalize();
+
+    const FlatHistoResult& expected = *perEvent.GetResultPtr();
+    const FlatHistoResult& result = *postFill.GetResultPtr();
+    for (std::size_t icell = 0; icell < cells; ++icell) {
+      CHECK(std::abs(result.sumW(icell) - expected.sumW(icell)) < 1e-12);
+      CHECK(std::abs(result.sumW2(icell) - expected.sumW2(icell)) < 1e-12);
+    }
+
+    // UniqueSampleID 0 filled x = 0.5, 1.5 and 5.5 with weights 0.25, 0.5 and 1.5 without normalisation
+    CHECK(result.nSamples() == normalisations.size());
+    const FlatHistoResult* first = result.sample(0);
+    CHECK(first != nullptr);
+    if (first) {
+      const double point[] = {0.5, 2.};
+      CHECK(first->sumW(first->cell(point)) == 0.25);
+      CHECK(first->sumW2(first->cell(point)) == 0.25*0.25);
+    }
+  }
+
+  // standard histograms also keep the object per slot
+  CHECK(SampleGraph::histogramBytes(cells, 1, 4, 1, false) > SampleGraph::histogramBytes(cells, 1, 4, 1, true));
+
+  return TestCheck::failures();
+}
@@ -0,0 +1,100 @@
+/**
+ * @file test-sum-weights-table.cc
+ * @brief Lookups in the indexed sum of weights table, detection of a changed text file and of corrupted tables
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/SumWeightsTable.h"
+
+#include "FastFrames/UniqueSampleID.h"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+int main() {
+
+  const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("test_sum_weights_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  const std::string textPath = (directory / "sum_of_weights.txt").string();
+  const std::string tablePath = SumWeightsTable::tablePath(textPath);
+  CHECK(tablePath == (directory / "sum_of_weights.bin").string());
+
+  {
+    std::ofstream out(textPath);
+    out << "410470 mc20a fullsim NOSYS 100.5\n"
+        << "410470 mc20a fullsim GEN_muR05 90\n"
+        << "# comment\n"
+        << "410470 mc20e fullsim NOSYS 200\n"
+        << "364100 mc20a fastsim NOSYS 3\n";
+  }
+
+  SumWeightsTable::write(tablePath, SumWeightsTable::readText(textPath), textPath);
+
+  {
+    const SumWeightsTable table(tablePath);
+    CHECK(table.size() == 4);
+    CHECK(table.matches(textPath));
+
+    const auto sumWeights = table.sumWeights(UniqueSampleID(410470, "mc20a", "fullsim"));
+    CHECK(sumWeights.size() == 2);
+    CHECK(sumWeights.at(0).first == "GEN_muR05" && sumWeights.at(0).second == 90);
+    CHECK(sumWeights.at(1).first == "NOSYS" && sumWeights.at(1).second == 100.5);
+
+    CHECK(table.sumWeights(UniqueSampleID(364100, "mc20a", "fastsim")).size() == 1);
+    CHECK(table.sumWeights(UniqueSampleID(410470, "mc20d", "fullsim")).empty());
+  }
+
+  // a copy with the same content has another modification time, the hash of the content is compared
+  const std::string copyPath = (directory / "copy.txt").string();
+  std::filesystem::copy_file(textPath, copyPath);
+  std::filesystem::last_write_time(copyPath, std::filesystem::last_write_time(textPath) + std::chrono::seconds(10));
+  CHECK(SumWeightsTable(tablePath).matches(copyPath));
+
+  // same size, different content
+  {
+    std::fstream out(copyPath, std::ios::in | std::ios::out);
+    out.seekp(0);
+    out << "410471";
+  }
+  std::filesystem::last_write_time(copyPath, std::filesystem::last_write_time(textPath) + std::chrono::seconds(20));
+  CHECK(!SumWeightsTable(tablePath).matches(copyPath));
+
+  // a key outside of the file
+  {
+    std::fstream out(tablePath, std::ios::in | std::ios::out | std::ios::binary);
+    out.seekp(8 + 4*sizeof(std::uint64_t));
+    const std::uint64_t offset = 1000000;
+    out.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+  }
+  {
+    const SumWeightsTable table(tablePath);
+    bool thrown(false);
+    try {
+      table.sumWeights(UniqueSampleID(410470, "mc20a", "fullsim"));
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+
+  // more entries than the file can hold
+  std::filesystem::resize_file(tablePath, 8 + 4*sizeof(std::uint64_t) + 10);
+  bool thrown(false);
+  try {
+    const SumWeightsTable table(tablePath);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  std::filesystem::remove_all(directory);
+
+  return TestCheck::failures();
+}
@@ -0,0 +1,114 @@
+/**
+ * @file test-systematic-index.cc
+ * @brief SystematicIndex gives the same replacements as SystematicReplacer, also for columns added after it is built,
+ * and the time of both for the lookups done while booking the histograms of a large config
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/SystematicIndex.h"
+
+#include "FastFrames/Systematic.h"
+#include "FastFrames/SystematicReplacer.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+int main() {
+
+  // 100 objects with 4 components, each systematic varies the components of 5 objects
+  const std::size_t nObjects = 100;
+  const std::size_t nSystematics = 200;
+  const std::vector<std::string> components = {"pt", "eta", "phi", "e"};
+
+  std::vector<std::shared_ptr<Systematic> > systematics = {std::make_shared<Systematic>("NOSYS")};
+  for (std::size_t isyst = 0; isyst < nSystematics; ++isyst) {
+    systematics.emplace_back(std::make_shared<Systematic>("SYST" + std::to_string(isyst)));
+  }
+
+  std::vector<std::string> branches;
+  for (std::size_t iobject = 0; iobject < nObjects; ++iobject) {
+    for (const auto& icomponent : components) {
+      const std::string name = "obj" + std::to_string(iobject) + "_" + icomponent + "_";
+      branches.emplace_back(name + "NOSYS");
+      for (std::size_t isyst = 0; isyst < nSystematics; ++isyst) {
+        if (isyst % (nObjects/5) == iobject % (nObjects/5)) branches.emplace_back(name + systematics.at(isyst + 1)->name());
+      }
+    }
+  }
+
+  SystematicReplacer replacer;
+  for (const auto& ibranch : branches) {
+    replacer.addBranch(ibranch);
+  }
+  replacer.matchSystematicVariables(branches, systematics);
+
+  // selections and variables of the regions
+  std::vector<std::string> formulas;
+  for (std::size_t iobject = 0; iobject + 1 < nObjects; ++iobject) {
+    const std::string first = "obj" + std::to_string(iobject);
+    const std::string second = "obj" + std::to_string(iobject + 1);
+    formulas.emplace_back(first + "_pt_NOSYS > 25e3 && std::abs(" + second + "_eta_NOSYS) < 2.5");
+    formulas.emplace_back(first + "_pt_NOSYS*" + second + "_e_NOSYS");
+    formulas.emplace_back("weight_mc_NOSYS*" + first + "_phi_NOSYS");
+  }
+
+  SystematicIndex index(replacer);
+
+  // same replacements, every formula is replaced several times per systematic
+  const std::size_t nRepeat = 10;
+  for (const auto& isyst : systematics) {
+    for (const auto& iformula : formulas) {
+      CHECK(index.replaceString(iformula, isyst) == replacer.replaceString(iformula, isyst));
+    }
+  }
+
+  auto time = [&](auto replace) {
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t size(0);
+    for (std::size_t irepeat = 0; irepeat < nRepeat; ++irepeat) {
+      for (const auto& isyst : systematics) {
+        for (const auto& iformula : formulas) {
+          size += replace(iformula, isyst).size();
+        }
+      }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(size > 0);
+    return elapsed.count();
+  };
+
+  const double replacerTime = time([&replacer](const std::string& formula, const std::shared_ptr<Systematic>& systematic) {
+    return replacer.replaceString(formula, systematic);
+  });
+  const double indexTime = time([&index](const std::string& formula, const std::shared_ptr<Systematic>& systematic) {
+    return index.replaceString(formula, systematic);
+  });
+
+  std::cout << nRepeat*systematics.size()*formulas.size() << " replacements, SystematicReplacer: " << replacerTime
+            << " s, SystematicIndex: " << indexTime << " s, computed by the replacer: " << index.nComputed() << "\n";
+
+  // lookups of the branches
+  CHECK(index.branchExists("obj0_pt_NOSYS"));
+  CHECK(!index.branchExists("obj0_pt"));
+  CHECK(index.affects("obj0_pt_NOSYS", "SYST0"));
+  CHECK(!index.affects("obj0_pt_NOSYS", "SYST1"));
+
+  // a column defined after the index is built changes the replacement of a cached formula
+  const std::string formula = "jet_sorted_NOSYS*obj1_pt_NOSYS";
+  const std::shared_ptr<Systematic>& systematic = systematics.at(3);
+  CHECK(index.replaceString(formula, systematic) == formula);
+  CHECK(!index.branchExists("jet_sorted_NOSYS"));
+
+  replacer.addVariableAndEffectiveSystematics("jet_sorted_NOSYS", {"NOSYS", systematic->name()});
+  CHECK(index.branchExists("jet_sorted_NOSYS"));
+  CHECK(index.affects("jet_sorted_NOSYS", systematic->name()));
+  CHECK(index.replaceString(formula, systematic) == replacer.replaceString(formula, systematic));
+  CHECK(index.replaceString(formula, systematic) != formula);
+
+  return TestCheck::failures();
+}
@@ -0,0 +1,112 @@
+/**
+ * @file test-weight-aggregates.cc
+ * @brief Matching of the systematics to the groups of aggregated_weight_variations, envelope and RMS of a group of variations
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/HistoAxis.h"
+#include "TutorialClass/SampleGraph.h"
+#include "TutorialClass/SystematicHistoAction.h"
+
+#include "FastFrames/Variable.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+int main() {
+
+  // groups match the whole systematic name, not a prefix
+  const auto groups = SampleGraph::aggregationGroups("JER:JET_JER_.*, PDF:GEN_PDF2600(0[1-9]|[1-9][0-9])");
+  CHECK(groups.size() == 2);
+  CHECK(SampleGraph::aggregationGroup("JET_JER_EffectiveNP_1", groups) == "JER");
+  CHECK(SampleGraph::aggregationGroup("JET_JERx_EffectiveNP_1", groups).empty());
+  CHECK(SampleGraph::aggregationGroup("GEN_PDF260001", groups) == "PDF");
+  CHECK(SampleGraph::aggregationGroup("GEN_PDF260099", groups) == "PDF");
+  CHECK(SampleGraph::aggregationGroup("GEN_PDF260000", groups).empty());
+  CHECK(SampleGraph::aggregationGroup("GEN_PDF2600011", groups).empty());
+
+  // an explicit list of systematics
+  const auto list = SampleGraph::aggregationGroups("SCALE:GEN_MUR05_MUF05|GEN_MUR2_MUF2");
+  CHECK(SampleGraph::aggregationGroup("GEN_MUR2_MUF2", list) == "SCALE");
+  CHECK(SampleGraph::aggregationGroup("GEN_MUR2_MUF1", list).empty());
+
+  for (const std::string invalid : {"JET_JER", ":JET_JER.*", "JER:", "JER:JET_(JER"}) {
+    bool thrown(false);
+    try {
+      SampleGraph::aggregationGroups(invalid);
+    } catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+
+  // 2 bins, 3 variations: sumW and sumW2 per [variation x bin] including underflow and overflow,
+  // sumw, sumw2, sumwx, sumwx2 per variation
+  Variable x("x");
+  x.setBinning(0., 2., 2);
+  const HistoAxis axis(x);
+  SystematicHistoResult result(axis, "", 3);
+  result.add({0, 1, 4, 0,
+              0, 3, 2, 0,
+              0, 2, 3, 0},
+             {0, 1, 16, 0,
+              0, 9, 4, 0,
+              0, 4, 9, 0},
+             {5, 17, 6.5, 9.25,
+              5, 13, 4.5, 5.75,
+              5, 13, 5.5, 7.75},
+             {10, 10, 12});
+
+  // only values within the axis range enter the statistics
+  std::vector<double> sumW(3*axis.nbinsWithFlows(), 0.);
+  std::vector<double> sumW2(sumW.size(), 0.);
+  std::vector<double> stats(3*SystematicHistoResult::nStats, 0.);
+  result.fillValue(sumW.data(), sumW2.data(), stats.data(), 1, 1.5, 2.);
+  result.fillValue(sumW.data(), sumW2.data(), stats.data(), 1, 5., 3.);
+  CHECK(sumW.at(axis.nbinsWithFlows() + 2) == 2 && sumW.at(axis.nbinsWithFlows() + 3) == 3);
+  CHECK(stats.at(4) == 2 && stats.at(5) == 4 && stats.at(6) == 3 && stats.at(7) == 4.5);
+  CHECK(stats.at(0) == 0 && stats.at(8) == 0);
+
+  const VariationAggregates aggregates = result.aggregateBins({0, 1, 2});
+  const auto up = static_cast<std::size_t>(VariationAggregate::ENVELOPE_UP);
+  const auto down = static_cast<std::size_t>(VariationAggregate::ENVELOPE_DOWN);
+  const auto rmsUp = static_cast<std::size_t>(VariationAggregate::RMS_UP);
+  const auto rmsDown = static_cast<std::size_t>(VariationAggregate::RMS_DOWN);
+
+  CHECK(aggregates.contents[up][1] == 3 && aggregates.contents[down][1] == 1);
+  CHECK(aggregates.contents[up][2] == 4 && aggregates.contents[down][2] == 2);
+
+  // the errors of the envelope are the errors of the variations at the maximum and minimum
+  CHECK(aggregates.errors[up][1] == 3 && aggregates.errors[down][1] == 1);
+  CHECK(aggregates.errors[up][2] == 4 && aggregates.errors[down][2] == 2);
+
+  // mean 2 +- 1 (sum of the squared deviations / (N - 1)), error sqrt((1 + 9 + 4)/3)
+  CHECK(std::abs(aggregates.contents[rmsUp][1] - 3) < 1e-12);
+  CHECK(std::abs(aggregates.contents[rmsDown][1] - 1) < 1e-12);
+  CHECK(std::abs(aggregates.contents[rmsUp][2] - 4) < 1e-12);
+  CHECK(std::abs(aggregates.errors[rmsUp][1] - std::sqrt(14./3.)) < 1e-12);
+  CHECK(aggregates.errors[rmsUp][1] == aggregates.errors[rmsDown][1]);
+
+  // a variation shared by two members counts twice: 1, 1, 3 -> mean 5/3 +- sqrt(4/3)
+  const VariationAggregates shared = result.aggregateBins({0, 0, 1});
+  CHECK(std::abs(shared.contents[rmsUp][1] - (5./3. + std::sqrt(4./3.))) < 1e-12);
+  CHECK(std::abs(shared.entries - 10) < 1e-12);
+
+  // a single member has no spread
+  const VariationAggregates single = result.aggregateBins({2});
+  CHECK(single.contents[rmsUp][1] == 2 && single.contents[rmsDown][1] == 2);
+
+  // empty underflow
+  CHECK(aggregates.contents[up][0] == 0 && aggregates.errors[rmsUp][0] == 0);
+
+  CHECK(std::abs(aggregates.entries - 32./3.) < 1e-12);
+
+  // the statistics are the means of those of the variations
+  CHECK(std::abs(aggregates.stats[0] - 5) < 1e-12 && std::abs(aggregates.stats[1] - 43./3.) < 1e-12);
+  CHECK(std::abs(aggregates.stats[2] - 5.5) < 1e-12 && std::abs(aggregates.stats[3] - 7.5833333333333333) < 1e-12);
+
+  return TestCheck::failures();
+}
@@ -0,0 +1,76 @@
+/**
+ * @file test-xsection-file-reader.cc
+ * @brief Selection of the lines of the used DSIDs from a cross-section file
+ *
+ */
+
+#include "Check.h"
+
+#include "TutorialClass/XSectionFileReader.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+int main() {
+
+  const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("test_xsection_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(directory);
+  const std::string path = (directory / "PMGxsecDB.txt").string();
+
+  {
+    std::ofstream out(path);
+    out << "dataset_number/I:physics_short/C:crossSection/D:genFiltEff/D:kFactor/D\n"
+        << "# comment\n"
+        << "410470\tttbar_nonallhad\t729.77\t0.5438\t1.13975\n"
+        << "999999\tother\t1.0\t1.0\t1.0\n"
+        << "4104700\tprefix_of_a_used_dsid\t1.0\t1.0\t1.0\n"
+        << "364100 Zmumu 1.9 0.82 0.97\r\n"
+        << "410470abc\tnot_a_dsid\t1.0\t1.0\t1.0\n"
+        << "\n"
+        << "  410470\tttbar_nonallhad_second\t730.0\t0.5438\t1.13975";
+  }
+
+  // sorted, as required by the reader
+  const std::vector<int> usedDSIDs = {364100, 410470};
+  const XSectionFileReader reader(path, usedDSIDs);
+
+  CHECK(reader.nDSIDLines() == 5);
+  CHECK(reader.lines().size() == 3);
+  if (reader.lines().size() == 3) {
+    CHECK(reader.lines().at(0).first == 364100);
+    CHECK(reader.lines().at(0).second == "364100 Zmumu 1.9 0.82 0.97\r");
+
+    // same DSID, order of the file
+    CHECK(reader.lines().at(1).first == 410470);
+    CHECK(reader.lines().at(1).second.find("ttbar_nonallhad\t") != std::string::npos);
+    CHECK(reader.lines().at(2).first == 410470);
+    CHECK(reader.lines().at(2).second.find("ttbar_nonallhad_second") != std::string::npos);
+  }
+
+  // the header and the selected lines are written, the other lines are dropped
+  const std::string selectedPath = (directory / "selected.txt").string();
+  reader.write(selectedPath);
+  std::ifstream in(selectedPath);
+  std::stringstream content;
+  content << in.rdbuf();
+  const std::string selected = content.str();
+  CHECK(selected.find("dataset_number/I") == 0);
+  CHECK(selected.find("# comment") != std::string::npos);
+  CHECK(selected.find("410470abc") != std::string::npos);
+  CHECK(selected.find("999999") == std::string::npos);
+  CHECK(selected.find("prefix_of_a_used_dsid") == std::string::npos);
+  CHECK(selected.find("Zmumu") < selected.find("ttbar_nonallhad\t"));
+
+  // nothing used
+  const XSectionFileReader none(path, {});
+  CHECK(none.lines().empty());
+  CHECK(none.nDSIDLines() == 5);
+
+  std::filesystem::remove_all(directory);
+
+  return TestCheck::failures();
+}
@@ -0,0 +1,56 @@
+#include "TutorialClass/MetadataProducer.h"
+#include "TutorialClass/SumWeightsTable.h"
+
+#include "FastFrames/Logger.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+
+  std::string output;
+  std::size_t nThreads = std::thread::hardware_concurrency();
+  std::vector<std::string> directories;
+  std::string convert;
+  std::string treeName = "reco";
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (argument == "--output_path" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (argument == "--threads" && i + 1 < argc) {
+      nThreads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (argument == "--tree" && i + 1 < argc) {
+      treeName = argv[++i];
+    } else if (argument == "--convert" && i + 1 < argc) {
+      convert = argv[++i];
+    } else {
+      directories.emplace_back(argument);
+    }
+  }
+
+  // index an existing sum_of_weights.txt
+  if (!convert.empty()) {
+    SumWeightsTable::write(SumWeightsTable::tablePath(convert), SumWeightsTable::readText(convert), convert);
+    return 0;
+  }
+
+  if (output.empty() || directories.empty()) {
+    std::cerr << "Usage: " << argv[0] << " --output_path <directory> [--threads <n>] [--tree <name>] <directory with ROOT files> [<directory> ...]\n";
+    std::cerr << "       " << argv[0] << " --convert <sum_of_weights.txt>\n";
+    return 1;
+  }
+
+  MetadataProducer producer(nThreads, treeName);
+  producer.scan(directories);
+  if (producer.nFiles() == 0) {
+    LOG(ERROR) << "No file with metadata found\n";
+    return 1;
+  }
+  producer.write(output);
+
+  return 0;
+}